@@ -0,0 +1,156 @@
+#ifndef ACTION_SET_H
+#define ACTION_SET_H
+
+#include "utils.h"
+#include <vector>
+#include <assert.h>
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+// Set of actions stored as a bit mask
+// Domains can keep one inside their state and update it in Step, so that
+// legal actions can be sampled or iterated without regenerating them
+
+class ACTION_SET
+{
+public:
+
+	ACTION_SET()
+		: NumActions(0),
+		Count(0)
+	{
+	}
+
+	ACTION_SET(int numActions)
+	{
+		Resize(numActions);
+	}
+
+	// Resize to hold numActions actions, all of which are removed
+	void Resize(int numActions)
+	{
+		NumActions = numActions;
+		Words.assign((numActions + 63) / 64, 0);
+		Count = 0;
+	}
+
+	void Clear()
+	{
+		for (size_t w = 0; w < Words.size(); ++w)
+			Words[w] = 0;
+		Count = 0;
+	}
+
+	void SetAll()
+	{
+		for (size_t w = 0; w < Words.size(); ++w)
+			Words[w] = ~uint64_t(0);
+		if (NumActions % 64)
+			Words.back() = (uint64_t(1) << (NumActions % 64)) - 1;
+		Count = NumActions;
+	}
+
+	void Add(int action)
+	{
+		assert(action >= 0 && action < NumActions);
+		uint64_t& word = Words[action >> 6];
+		uint64_t bit = uint64_t(1) << (action & 63);
+		Count += (word & bit) == 0;
+		word |= bit;
+	}
+
+	void Remove(int action)
+	{
+		assert(action >= 0 && action < NumActions);
+		uint64_t& word = Words[action >> 6];
+		uint64_t bit = uint64_t(1) << (action & 63);
+		Count -= (word & bit) != 0;
+		word &= ~bit;
+	}
+
+	void Set(int action, bool legal)
+	{
+		if (legal)
+			Add(action);
+		else
+			Remove(action);
+	}
+
+	bool Contains(int action) const
+	{
+		assert(action >= 0 && action < NumActions);
+		return (Words[action >> 6] >> (action & 63)) & 1;
+	}
+
+	int Size() const { return Count; }
+	bool Empty() const { return Count == 0; }
+	int GetNumActions() const { return NumActions; }
+
+	// Select an action uniformly at random from the set
+	int Sample() const
+	{
+		assert(Count > 0);
+		int r = UTILS::Random(Count);
+		for (size_t w = 0; w < Words.size(); ++w)
+		{
+			uint64_t word = Words[w];
+			int bits = __builtin_popcountll(word);
+			if (r < bits)
+			{
+				for (; r > 0; --r)
+					word &= word - 1;
+				return w * 64 + __builtin_ctzll(word);
+			}
+			r -= bits;
+		}
+		assert(false);
+		return -1;
+	}
+
+	// Iterate with: for (int a = set.First(); a >= 0; a = set.Next(a))
+	int First() const
+	{
+		return Find(0);
+	}
+
+	int Next(int action) const
+	{
+		return Find(action + 1);
+	}
+
+	void AppendTo(std::vector<int>& actions) const
+	{
+		for (size_t w = 0; w < Words.size(); ++w)
+		{
+			uint64_t word = Words[w];
+			while (word)
+			{
+				actions.push_back(w * 64 + __builtin_ctzll(word));
+				word &= word - 1;
+			}
+		}
+	}
+
+private:
+
+	int Find(int action) const
+	{
+		int w = action >> 6;
+		if (w >= (int) Words.size())
+			return -1;
+		uint64_t word = Words[w] & (~uint64_t(0) << (action & 63));
+		while (!word)
+		{
+			if (++w >= (int) Words.size())
+				return -1;
+			word = Words[w];
+		}
+		return w * 64 + __builtin_ctzll(word);
+	}
+
+	std::vector<uint64_t> Words;
+	int NumActions;
+	int Count;
+};
+
+#endif // ACTION_SET_H
@@ -1,20 +1,69 @@
 #include "bandit.h"
+#include "profiler.h"
 
 Bandit::Bandit(const unsigned int numberOfArms,
-	const unsigned int rewardBufferSize) : playIndex(0), numberOfArms(numberOfArms), rewardBufferSize(rewardBufferSize)
+	const unsigned int rewardBufferSize,
+	const unsigned int extraColumns) : generator(UTILS::RandomWord()),
+	playIndex(0), numberOfArms(numberOfArms), rewardBufferSize(rewardBufferSize)
 {
+	lastEstimatedValuesOffset = (Arm::NUMBER_OF_COLUMNS + extraColumns)*numberOfArms;
+	statistics.assign(lastEstimatedValuesOffset + numberOfArms*(rewardBufferSize + 1), 0.0);
+	scores.reserve(numberOfArms);
+	candidateValueIndices.reserve(numberOfArms);
+	actionPlayCandidates.reserve(numberOfArms);
 	for (int index = 0; index < numberOfArms; index++) 
 	{
-		arms.push_back(new Arm(rewardBufferSize));
 		actions.push_back(index);
 	}
 }
 
 Bandit::~Bandit() 
 {
-	for (int index = 0; index < arms.size(); index++) 
+}
+
+size_t Bandit::memoryUsage() const
+{
+	return sizeof(*this)
+		+ statistics.capacity()*sizeof(double)
+		+ scores.capacity()*sizeof(double)
+		+ (actions.capacity() + actionPlayCandidates.capacity() + candidateValueIndices.capacity()
+			+ legalScratch.capacity())*sizeof(int);
+}
+
+void Bandit::decay(const double factor)
+{
+	for (int column = Arm::COUNT; column <= Arm::SQUARED_VALUE; column++)
+	{
+		double* values = &statistics[column*numberOfArms];
+		for (int index = 0; index < numberOfArms; index++)
+		{
+			values[index] *= factor;
+		}
+	}
+}
+
+const double Bandit::count() const
+{
+	const double* counts = &statistics[Arm::COUNT*numberOfArms];
+	return std::accumulate(counts, counts + numberOfArms, 0.0);
+}
+
+const double Bandit::mean() const
+{
+	const double count = this->count();
+	if (count == 0)
 	{
-		delete arms[index];
+		return 0;
+	}
+	const double* values = &statistics[Arm::VALUE*numberOfArms];
+	return std::accumulate(values, values + numberOfArms, 0.0) / count;
+}
+
+void Bandit::merge(const BanditShard& shard)
+{
+	for (size_t index = 0; index < shard.arms.size(); index++)
+	{
+		getArm(shard.arms[index]).update(shard.rewards[index]);
 	}
 }
 
@@ -23,7 +72,7 @@ int Bandit::play()
 	actionPlayCandidates.clear();
 	for (int index = 0; index < actions.size(); index++)
 	{
-		if (getArm(index)->size() > 0)
+		if (getArm(index).size() > 0)
 		{
 			actionPlayCandidates.push_back(index);
 		}
@@ -33,19 +82,19 @@ int Bandit::play()
 
 int Bandit::play(const std::vector<int>& legalArms)
 {
-	means.clear();
+	scores.clear();
 	for (int index = 0; index < legalArms.size(); index++)
 	{
-		means.push_back(arms[legalArms[index]]->mean());
+		scores.push_back(getArm(legalArms[index]).mean());
 	}
-	return legalArms[argmax(means)];
+	return legalArms[argmax(scores)];
 }
 
 void Bandit::update(const double reward) 
 {
 	if (playIndex >= 0) 
 	{
-		arms[playIndex]->update(reward);
+		getArm(playIndex).update(reward);
 	}
 }
 
@@ -57,16 +106,31 @@ int Bandit::sample()
 
 int Bandit::sampleFrom(const std::vector<int>& legalArms)
 {
+	PROFILE(BANDIT_SAMPLE);
 	playIndex = sampleArmFrom(legalArms);
 	return playIndex;
 }
 
+int Bandit::sampleArmFromSet(const ACTION_SET& legalArms)
+{
+	legalScratch.clear();
+	legalArms.AppendTo(legalScratch);
+	return sampleArmFrom(legalScratch);
+}
+
+int Bandit::sampleFrom(const ACTION_SET& legalArms)
+{
+	PROFILE(BANDIT_SAMPLE);
+	playIndex = sampleArmFromSet(legalArms);
+	return playIndex;
+}
+
 int EpsilonGreedy::sampleArmFrom(const std::vector<int>& legalArms)
 {
 	int index = 0;
-	if (randomDouble() <= epsilon)
+	if (generator.uniform() <= epsilon)
 	{
-		index = randomInt(legalArms.size());
+		index = randomIndex(legalArms.size());
 		return legalArms[index];
 	}
 	return play(legalArms);
@@ -79,113 +143,298 @@ UCB1::UCB1(
 
 int UCB1::sampleArmFrom(const std::vector<int>& legalArms)
 {
-	upperConfidences.clear();
+	scores.clear();
 	const int numberOfArms = legalArms.size();
 	int totalCount = 0;
 	for (int index = 0; index < numberOfArms; index++) 
 	{
-		Arm* arm = getArm(legalArms[index]);
-		totalCount += arm->size();
+		totalCount += getArm(legalArms[index]).size();
 	}
 	for (int index = 0; index < numberOfArms; index++)
 	{
-		Arm* arm = getArm(legalArms[index]);
-		const double meanReward = arm->mean();
-		const int numberOfRewards = arm->size();
+		Arm arm = getArm(legalArms[index]);
+		const double meanReward = arm.mean();
+		const int numberOfRewards = arm.size();
 		if (numberOfRewards == 0)
 		{
-			upperConfidences.push_back(std::numeric_limits<double>::infinity());
+			scores.push_back(std::numeric_limits<double>::infinity());
 		}
 		else
 		{
 			const double explorationTerm = sqrt(2 * log(totalCount) / numberOfArms);
-			upperConfidences.push_back(meanReward + explorationConstant*explorationTerm);
+			scores.push_back(meanReward + explorationConstant*explorationTerm);
 		}
 	}
-	return legalArms[argmax(upperConfidences)];
+	return legalArms[argmax(scores)];
 }
 
 ThompsonSampling::ThompsonSampling(
 	const unsigned int numberOfArms,
 	const unsigned int rewardBufferSize,
     	const unsigned int updateDelay,
-	const unsigned int beta0) : Bandit(numberOfArms, rewardBufferSize), lambda(0), rewardBufferSize(rewardBufferSize), updateDelay(updateDelay), beta0(beta0)
+	const unsigned int beta0) : Bandit(numberOfArms, rewardBufferSize, NUMBER_OF_COLUMNS), lambda(0), rewardBufferSize(rewardBufferSize), updateDelay(updateDelay), beta0(beta0)
 {
-	for (int index = 0; index < numberOfArms; index++)
-	{
-		means.push_back(0);
-		vars.push_back(0);
-		counts.push_back(0);
-	}
+	sampledNormals.reserve(numberOfArms);
+}
+
+int ThompsonSampling::play()
+{
+	flush();
+	return Bandit::play();
+}
+
+int ThompsonSampling::play(const std::vector<int>& legalArms)
+{
+	flush();
+	return Bandit::play(legalArms);
 }
 
 void ThompsonSampling::update(const double reward)
 {
-        Bandit::update(reward);
+	PROFILE(BANDIT_UPDATE);
 	int currentIndex = currentPlayIndex();
-	Arm* arm = getArm(currentIndex);
-	int count = arm->size();
-	if (count % updateDelay == 0)
+	if (currentIndex < 0)
 	{
-		counts[currentIndex] += 1;
-		means[currentIndex] = arm->mean();
-		double std = arm->std();
-		vars[currentIndex] = std*std;
+		return;
 	}
+	if (updateDelay <= 1)
+	{
+		Bandit::update(reward);
+		extraColumn(POSTERIOR_COUNT)[currentIndex] += 1;
+		updatePosterior(currentIndex);
+		return;
+	}
+	double& pendingCount = extraColumn(PENDING_COUNT)[currentIndex];
+	double& pendingValue = extraColumn(PENDING_VALUE)[currentIndex];
+	pendingCount += 1;
+	pendingValue += reward;
+	extraColumn(PENDING_SQUARED_VALUE)[currentIndex] += reward*reward;
+	// Convergence sees every reward, as if it had not been buffered
+	Arm arm = getArm(currentIndex);
+	arm.recordEstimate((arm.sum() + pendingValue) / (arm.count() + pendingCount));
+	if (pendingCount >= updateDelay)
+	{
+		flush(currentIndex);
+	}
+}
+
+void ThompsonSampling::updatePosterior(const int armIndex)
+{
+	const double n = extraColumn(POSTERIOR_COUNT)[armIndex];
+	if (n == 0)
+	{
+		return;
+	}
+	Arm arm = getArm(armIndex);
+	const double mean = arm.mean();
+	const double std = arm.std();
+	const double var = std*std;
+	const double delta = mean - mu0;
+	const double lambda1 = lambda0 + n;
+	assert(lambda1 > 0);
+	const double mu1 = (lambda0*mu0 + n*mean) / lambda1;
+	const double alpha1 = alpha0 + n / 2;
+	assert(alpha1 >= 1);
+	const double beta1 = beta0 + 0.5*(n*var + (lambda0*n*delta*delta) / lambda1);
+	assert(beta1 >= 0);
+	extraColumn(POSTERIOR_MEAN)[armIndex] = mu1;
+	extraColumn(POSTERIOR_SCALE)[armIndex] = beta1 / lambda1;
+	extraColumn(GAMMA_D)[armIndex] = alpha1 - 1.0 / 3;
+	extraColumn(GAMMA_C)[armIndex] = 1.0 / sqrt(9 * extraColumn(GAMMA_D)[armIndex]);
 }
 
 void ThompsonSampling::flush()
 {
+	int numberOfArms = getNumberOfArms();
+	for (int index = 0; index < numberOfArms; index++)
+	{
+		flush(index);
+	}
+}
 
+void ThompsonSampling::flush(const int armIndex)
+{
+	double* pendingCount = extraColumn(PENDING_COUNT);
+	if (pendingCount[armIndex] == 0)
+	{
+		return;
+	}
+	double* pendingValue = extraColumn(PENDING_VALUE);
+	double* pendingSquaredValue = extraColumn(PENDING_SQUARED_VALUE);
+	// Their estimates were recorded as they were buffered
+	getArm(armIndex).add((int)pendingCount[armIndex], pendingValue[armIndex], pendingSquaredValue[armIndex]);
+	extraColumn(POSTERIOR_COUNT)[armIndex] += pendingCount[armIndex];
+	pendingCount[armIndex] = 0;
+	pendingValue[armIndex] = 0;
+	pendingSquaredValue[armIndex] = 0;
+	updatePosterior(armIndex);
 }
 
 void ThompsonSampling::reset()
 {
 	Bandit::reset();
+}
+
+void ThompsonSampling::decay(const double factor)
+{
+	flush();
+	Bandit::decay(factor);
+	int numberOfArms = getNumberOfArms();
+	double* counts = extraColumn(POSTERIOR_COUNT);
+	for (int index = 0; index < numberOfArms; index++)
+	{
+		counts[index] *= factor;
+		updatePosterior(index);
+	}
+}
+
+void ThompsonSampling::merge(const BanditShard& shard)
+{
+	flush();
+	Bandit::merge(shard);
+	double* counts = extraColumn(POSTERIOR_COUNT);
+	for (size_t index = 0; index < shard.arms.size(); index++)
+	{
+		counts[shard.arms[index]] += 1;
+	}
 	int numberOfArms = getNumberOfArms();
 	for (int index = 0; index < numberOfArms; index++)
 	{
-		means[index] = 0;
-		vars[index] = 0;
-		counts[index] = 0;
+		updatePosterior(index);
 	}
 }
 
+size_t ThompsonSampling::memoryUsage() const
+{
+	return Bandit::memoryUsage() + sizeof(*this) - sizeof(Bandit)
+		+ sampledNormals.capacity()*sizeof(double);
+}
+
 int ThompsonSampling::sampleArmFrom(const std::vector<int>& legalArms)
 {
-	sampledMeans.clear();
+	// The posterior parameters are cached, so each arm only costs a gamma
+	// draw for the precision and a normal draw for the mean:
+	// tau ~ Gamma(alpha1, 1 / beta1), mean ~ Normal(mu1, 1 / (lambda1 * tau))
+	const double* counts = extraColumn(POSTERIOR_COUNT);
+	const double* posteriorMeans = extraColumn(POSTERIOR_MEAN);
+	const double* posteriorScales = extraColumn(POSTERIOR_SCALE);
+	const double* gammaD = extraColumn(GAMMA_D);
+	const double* gammaC = extraColumn(GAMMA_C);
 	int numberOfArms = legalArms.size();
-	int rewardBufferSize = getRewardBufferSize();
+	scores.resize(numberOfArms);
+	sampledNormals.resize(numberOfArms);
 	for (int index = 0; index < numberOfArms; index++)
 	{
 		int armIndex = legalArms[index];
-		const double mean = means[armIndex];
-		const double var = vars[armIndex];
-		double n = counts[armIndex];
-		if (n == 0)
+		scores[index] = counts[armIndex] == 0 ? 1.0
+			: generator.gamma(gammaD[armIndex], gammaC[armIndex]);
+		sampledNormals[index] = generator.normal();
+	}
+	for (int index = 0; index < numberOfArms; index++)
+	{
+		int armIndex = legalArms[index];
+		scores[index] = counts[armIndex] == 0 ? std::numeric_limits<double>::infinity()
+			: posteriorMeans[armIndex] + sampledNormals[index] * sqrt(posteriorScales[armIndex] / scores[index]);
+	}
+	return legalArms[argmax(scores)];
+}
+
+// The same posterior draws as sampleArmFrom, over the set in place. The
+// best arm is kept as the set is walked, with ties broken uniformly by
+// reservoir sampling, so nothing is copied out or scored twice
+int ThompsonSampling::sampleArmFromSet(const ACTION_SET& legalArms)
+{
+	const double* counts = extraColumn(POSTERIOR_COUNT);
+	const double* posteriorMeans = extraColumn(POSTERIOR_MEAN);
+	const double* posteriorScales = extraColumn(POSTERIOR_SCALE);
+	const double* gammaD = extraColumn(GAMMA_D);
+	const double* gammaC = extraColumn(GAMMA_C);
+	int bestArm = -1;
+	int ties = 0;
+	double bestScore = -std::numeric_limits<double>::infinity();
+	for (int armIndex = legalArms.First(); armIndex >= 0; armIndex = legalArms.Next(armIndex))
+	{
+		double score = std::numeric_limits<double>::infinity();
+		if (counts[armIndex] != 0)
 		{
-			sampledMeans.push_back(std::numeric_limits<double>::infinity());
+			const double precision = generator.gamma(gammaD[armIndex], gammaC[armIndex]);
+			score = posteriorMeans[armIndex] + generator.normal() * sqrt(posteriorScales[armIndex] / precision);
 		}
-		else
+		if (score > bestScore)
 		{
-			const double delta = mean - mu0;
-			const double lambda1 = lambda0 + n;
-			assert(lambda1 > 0);
-			const double mu1 = (lambda0*mu0 + n*mean) / lambda1;
-			const double alpha1 = alpha0 + n / 2;
-			assert(alpha1 >= 1);
-			const double beta1 = beta0 + 0.5*(n*var + (lambda0*n*delta*delta) / lambda1);
-			assert(beta1 >= 0);
-			boost::gamma_distribution<> gd(alpha1, 1/beta1);
-			boost::variate_generator<boost::mt19937&, boost::gamma_distribution<> > var_gamma(generator, gd);
-			double gammaVariate = var_gamma();
-			const double normalizedVariance = 1.0 / (lambda1*gammaVariate);
-			const double normalizedMean = mu1;
-			boost::normal_distribution<double> nd(normalizedMean, sqrt(normalizedVariance));
-			boost::variate_generator<boost::mt19937&, boost::normal_distribution<double> > var_normal(generator, nd);
-			double sampledValue = var_normal();
-			sampledMeans.push_back(sampledValue);
+			bestArm = armIndex;
+			bestScore = score;
+			ties = 1;
+		}
+		else if (score == bestScore && randomIndex(++ties) == 0)
+		{
+			bestArm = armIndex;
 		}
 	}
-	return legalArms[argmax(sampledMeans)];
+	return bestArm;
+}
+
+// A buffered arm must reach the same convergence state as an unbuffered arm
+// fed the same rewards, whatever the update delay
+static void unitTestBufferedConvergence(const unsigned int updateDelay)
+{
+	const unsigned int capacity = 8;
+	const double epsilon = 0.02;
+	ThompsonSampling unbuffered(1, capacity, 1, 1);
+	ThompsonSampling buffered(1, capacity, updateDelay, 1);
+	const std::vector<int> legalArms(1, 0);
+	bool converged = false;
+	for (int i = 0; i < 400; i++)
+	{
+		// Integer rewards keep both sums exact
+		const double reward = (i % 3 == 0) ? 1 : 0;
+		unbuffered.play(legalArms);
+		unbuffered.update(reward);
+		buffered.play(legalArms);
+		buffered.update(reward);
+		assert(buffered.hasConverged(epsilon) == unbuffered.hasConverged(epsilon));
+		if (i < (int)capacity)
+		{
+			assert(!buffered.hasConverged(epsilon));
+		}
+		converged = converged || buffered.hasConverged(epsilon);
+	}
+	assert(converged);
+}
+
+// Sampling over a legal action set in place only returns arms of the set,
+// breaking ties between untried arms uniformly, and prefers the better arm
+static void unitTestSampleFromSet()
+{
+	ThompsonSampling bandit(5, 0, 1, 1);
+	ACTION_SET legal(5);
+	legal.Add(1);
+	legal.Add(3);
+	int picks[5] = { 0 };
+	for (int i = 0; i < 1000; i++)
+	{
+		picks[bandit.sampleFrom(legal)]++;
+	}
+	assert(picks[0] == 0 && picks[2] == 0 && picks[4] == 0);
+	assert(picks[1] > 400 && picks[3] > 400);
+
+	for (int i = 0; i < 100; i++)
+	{
+		bandit.sampleFrom(legal);
+		bandit.update(bandit.currentPlayIndex() == 3 ? 1 : 0);
+	}
+	picks[1] = picks[3] = 0;
+	for (int i = 0; i < 1000; i++)
+	{
+		picks[bandit.sampleFrom(legal)]++;
+	}
+	assert(picks[3] > 900);
+}
+
+void ThompsonSampling::unitTest()
+{
+	unitTestBufferedConvergence(1);
+	unitTestBufferedConvergence(4);
+	unitTestBufferedConvergence(7);
+	unitTestSampleFromSet();
 }
@@ -3,79 +3,139 @@
 #include <algorithm>
 #include <iterator>
 #include "random.h"
-#include <boost/random.hpp>
-#include <boost/random/gamma_distribution.hpp>
+#include "actionset.h"
+#include <assert.h>
 #include <time.h>
 #include <iostream>
 #include <random>
 #include <chrono>
 #include <cmath>
 
+// View of one arm's statistics, which live in the storage of its bandit.
+// Statistics are stored column by column, so column c of arm i is at
+// statistics[c * numberOfArms + i]
 class Arm
 {
 public:
-	Arm(const unsigned int capacity) : count(0), capacity(capacity)
+	enum
 	{
-		for (int index = 0; index < capacity + 1; index++)
-        {
-			lastEstimatedValues.push_back(0);
-		}
-		value = std::numeric_limits<double>::infinity();
-		squaredValue = std::numeric_limits<double>::infinity();
+		COUNT,
+		VALUE,
+		SQUARED_VALUE,
+		ESTIMATE_HEAD,	// Next slot of the ring of recent estimates
+		ESTIMATE_COUNT,	// Estimates in the ring, at most capacity + 1
+		DELTA_SUM,		// Sum of absolute changes between recent estimates
+		NUMBER_OF_COLUMNS
+	};
+
+	Arm(double* statistics, double* lastEstimatedValues, const int index,
+		const int numberOfArms, const unsigned int capacity)
+		: statistics(statistics + index), lastEstimatedValues(lastEstimatedValues + index*(capacity + 1)),
+		numberOfArms(numberOfArms), capacity(capacity)
+	{
+	}
+
+	void update(const double reward)
+	{
+		update(1, reward, reward*reward);
 	}
 
-	~Arm() {}
+	// Add a batch of rewards, given their count, sum and sum of squares
+	void update(const int count, const double value, const double squaredValue)
+	{
+		add(count, value, squaredValue);
+		recordEstimate(mean());
+	}
 
-	void update(const double reward) 
+	// Add a batch of rewards without recording an estimate, for rewards
+	// whose estimates were recorded as they arrived
+	void add(const int count, const double value, const double squaredValue)
 	{
-		if (count == 0)
+		column(COUNT) += count;
+		column(VALUE) += value;
+		column(SQUARED_VALUE) += squaredValue;
+	}
+
+	// Push an estimate of the mean into the ring of recent estimates
+	void recordEstimate(const double estimate)
+	{
+		if (capacity == 0)
 		{
-			value = 0;
-			squaredValue = 0;
+			return;
 		}
-		count += 1;
-		value += reward;
-		squaredValue += reward*reward;
+		const unsigned int slots = capacity + 1;
+		const unsigned int head = (unsigned int)column(ESTIMATE_HEAD);
+		const unsigned int newest = (head + capacity) % slots;
+		double& estimates = column(ESTIMATE_COUNT);
+		double& deltaSum = column(DELTA_SUM);
+		if (estimates > 0)
+		{
+			deltaSum += std::abs(estimate - lastEstimatedValues[newest]);
+		}
+		if (estimates < slots)
+		{
+			estimates += 1;
+		}
+		else
+		{
+			// The oldest estimate is about to be overwritten
+			deltaSum -= std::abs(lastEstimatedValues[(head + 1) % slots] - lastEstimatedValues[head]);
+			if (deltaSum < 0)
+			{
+				deltaSum = 0;
+			}
+		}
+		lastEstimatedValues[head] = estimate;
+		column(ESTIMATE_HEAD) = (head + 1) % slots;
 	}
-    
+
+	// The last capacity + 1 estimates of the mean are kept in a ring, along
+	// with the sum of absolute changes between them, so this is O(1).
+	// Estimates are counted apart from rewards, as decay scales the count
+	// of rewards and a batch of rewards may record a single estimate
     const bool hasConverged(const double epsilon)
     {
-        if(count < capacity + 1)
+        if(capacity == 0 || column(ESTIMATE_COUNT) < capacity + 1)
         {
             return false;
         }
-        double deltaSum = 0.0;
-        for(int index = 1; index < capacity + 1; index++)
-        {
-            deltaSum += std::abs(lastEstimatedValues[index]-lastEstimatedValues[index-1]);
-        }
-        return deltaSum/capacity < epsilon;
+        return column(DELTA_SUM)/capacity < epsilon;
     }
 
-	const double mean() 
+	const double count()
+	{
+		return column(COUNT);
+	}
+
+	const double sum()
+	{
+		return column(VALUE);
+	}
+
+	const double mean()
 	{
-	        if(count == 0)
+	        if(column(COUNT) == 0)
 		{
 		      return 0;
 		}
-	        return value/count;
+	        return column(VALUE)/column(COUNT);
 	}
 
 	void setValues(const double newValue, const double newSquaredValue, const int newCount)
 	{
-		value = newValue;
-		squaredValue = newSquaredValue;
-		count = newCount;
+		column(VALUE) = newValue;
+		column(SQUARED_VALUE) = newSquaredValue;
+		column(COUNT) = newCount;
 	}
 
-	const double std() 
+	const double std()
 	{
 		double mean = this->mean();
-		if (count == 0) {
+		if (column(COUNT) == 0) {
 			return 0;
 		}
 		double meanSquared = mean*mean;
-		double expectedSquaredSum = squaredValue / count;
+		double expectedSquaredSum = column(SQUARED_VALUE) / column(COUNT);
 		double res = expectedSquaredSum - meanSquared;
 		if(res < 0) {
             res = 0;
@@ -86,28 +146,63 @@ public:
 
 	const unsigned int size() const
 	{
-		return count;
+		return (unsigned int)statistics[COUNT*numberOfArms];
 	}
 
 	void reset()
 	{
-		value = std::numeric_limits<double>::infinity();
-		squaredValue = std::numeric_limits<double>::infinity();
-		count = 0;
+		setValues(0, 0, 0);
+		column(ESTIMATE_HEAD) = 0;
+		column(ESTIMATE_COUNT) = 0;
+		column(DELTA_SUM) = 0;
+		for (unsigned int index = 0; index < capacity + 1; index++)
+		{
+			lastEstimatedValues[index] = 0;
+		}
 	}
 private:
-	unsigned int count;
+	double& column(const int c)
+	{
+		return statistics[c*numberOfArms];
+	}
+
+	double* statistics;
+	double* lastEstimatedValues;
+	const int numberOfArms;
 	const unsigned int capacity;
-    std::vector<double> lastEstimatedValues;
-	double value;
-	double squaredValue;
+};
+
+// Rewards gathered for a bandit elsewhere, such as on another thread,
+// kept in the order they arrived until merged into it, so that merging
+// records the same estimates as updating the bandit directly would
+class BanditShard
+{
+public:
+	void update(const int armIndex, const double reward)
+	{
+		arms.push_back(armIndex);
+		rewards.push_back(reward);
+	}
+
+	void reset()
+	{
+		arms.clear();
+		rewards.clear();
+	}
+
+	std::vector<int> arms;
+	std::vector<double> rewards;
 };
 
 class Bandit
 {
 public:
 	Bandit(const unsigned int numberOfArms,
-		const unsigned int rewardBufferSize);
+		const unsigned int rewardBufferSize,
+		const unsigned int extraColumns = 0);
+	// Copies duplicate the statistics block, moves only take it over
+	Bandit(const Bandit& other) = default;
+	Bandit(Bandit&& other) = default;
 	virtual ~Bandit();
 
 	virtual int sampleArm()
@@ -124,26 +219,32 @@ public:
 	int sample();
 	virtual int sampleArmFrom(const std::vector<int>& legalArms) = 0;
 	int sampleFrom(const std::vector<int>& legalArms);
+	// Sample from the arms in a domain's legal action set. By default the
+	// set is copied out into a list; bandits can iterate it in place instead
+	virtual int sampleArmFromSet(const ACTION_SET& legalArms);
+	int sampleFrom(const ACTION_SET& legalArms);
 	virtual void update(const double reward);
-	const unsigned int getNumberOfArms() 
+	// Number of rewards and mean reward over every arm
+	const double count() const;
+	const double mean() const;
+	const unsigned int getNumberOfArms()
 	{
 		return numberOfArms;
 	}
-	Arm* getArm(const int index) 
+	Arm getArm(const int index)
 	{
-		return arms[index];
+		return Arm(&statistics[0], &statistics[lastEstimatedValuesOffset], index, numberOfArms, rewardBufferSize);
 	}
     const bool hasConverged(const double epsilon)
     {
-        if (playIndex >= 0) 
+        if (playIndex >= 0)
         {
-            return arms[playIndex]->hasConverged(epsilon);
+            return getArm(playIndex).hasConverged(epsilon);
         }
         return false;
     }
-	int argmax(std::vector<double>& data) 
+	int argmax(const std::vector<double>& data)
 	{
-		static std::vector<int> candidateValueIndices;
 		candidateValueIndices.clear();
 		double bestValue = -std::numeric_limits<double>::infinity();
 		int n = data.size();
@@ -160,44 +261,83 @@ public:
 				candidateValueIndices.push_back(index);
 			}
 		}
-		return candidateValueIndices[randomInt(candidateValueIndices.size())];
+		return candidateValueIndices[randomIndex(candidateValueIndices.size())];
 	}
 
 	virtual void reset()
 	{
-		int n = arms.size();
-		for (int index = 0; index < n; index++)
-		{
-			arms[index]->reset();
-		}
+		std::fill(statistics.begin(), statistics.end(), 0.0);
 	}
 
+	// Scale the evidence of every arm by factor, keeping the means
+	virtual void decay(const double factor);
+
 	const unsigned int getRewardBufferSize() const {
 		return rewardBufferSize;
 	}
 
+	// Fold the rewards of a shard into the arms
+	virtual void merge(const BanditShard& shard);
+
+	// Take every statistic of another bandit of the same shape
+	void copyStatistics(const Bandit& other)
+	{
+		assert(other.statistics.size() == statistics.size());
+		std::copy(other.statistics.begin(), other.statistics.end(), statistics.begin());
+	}
+
+	void seed(const uint64_t seed)
+	{
+		generator = FastRandom(seed);
+	}
+
+	// Bytes owned by this bandit
+	virtual size_t memoryUsage() const;
+
+protected:
+	// Per-arm columns requested by derived bandits, after the Arm columns
+	double* extraColumn(const int c)
+	{
+		return &statistics[(Arm::NUMBER_OF_COLUMNS + c)*numberOfArms];
+	}
+
+	int randomIndex(const int range)
+	{
+		return generator.next() % range;
+	}
+
+	// Per-bandit generator, so that bandits can be used from several threads
+	FastRandom generator;
+	// Scratch space for per-arm scores
+	std::vector<double> scores;
+	// Scratch space for the arms of a legal action set
+	std::vector<int> legalScratch;
+
 private:
 	int playIndex;
 	const unsigned int numberOfArms;
 	const unsigned int rewardBufferSize;
-	std::vector<Arm*> arms;
-	std::vector<double> means;
+	// All arm statistics in one block: the Arm columns, the extra columns
+	// and then capacity + 1 recent estimates of each arm
+	std::vector<double> statistics;
+	int lastEstimatedValuesOffset;
 	std::vector<int> actions;
 	std::vector<int> actionPlayCandidates;
+	std::vector<int> candidateValueIndices;
 };
 
-class RandomBandit : public Bandit 
+class RandomBandit : public Bandit
 {
 public:
 	RandomBandit(const unsigned int numberOfArms) : Bandit(numberOfArms,1) {}
 	virtual ~RandomBandit() {}
 	virtual int sampleArmFrom(const std::vector<int>& legalArms)
 	{
-		return legalArms[randomInt(legalArms.size())];
+		return legalArms[randomIndex(legalArms.size())];
 	}
 };
 
-class EpsilonGreedy : public Bandit 
+class EpsilonGreedy : public Bandit
 {
 public:
 	EpsilonGreedy(
@@ -221,10 +361,9 @@ public:
 	virtual int sampleArmFrom(const std::vector<int>& legalArms);
 private:
 	const double explorationConstant;
-	std::vector<double> upperConfidences;
 };
 
-class ThompsonSampling : public Bandit 
+class ThompsonSampling : public Bandit
 {
 public:
 	ThompsonSampling(
@@ -232,18 +371,52 @@ public:
 		const unsigned int rewardBufferSize,
                 const unsigned int updateDelay,
 		const unsigned int beta0);
+	ThompsonSampling(const ThompsonSampling& other) = default;
+	ThompsonSampling(ThompsonSampling&& other) = default;
 	virtual ~ThompsonSampling() {}
+	virtual int play();
+	virtual int play(const std::vector<int>& legalArms);
 	virtual void update(const double reward);
 	virtual void reset();
+	virtual void decay(const double factor);
+	virtual void merge(const BanditShard& shard);
 	virtual int sampleArmFrom(const std::vector<int>& legalArms);
+	virtual int sampleArmFromSet(const ACTION_SET& legalArms);
+	virtual size_t memoryUsage() const;
+	// Fold buffered rewards into the arms and refresh their posteriors
 	void flush();
 
-	void setBetaAndLambda(double beta, double lambda) 
+	static void unitTest();
+
+	void setBetaAndLambda(double beta, double lambda)
 	{
 		beta0 = beta;
 		lambda0 = lambda;
+		for (unsigned int index = 0; index < getNumberOfArms(); index++)
+		{
+			updatePosterior(index);
+		}
 	}
 private:
+	// With an update delay above one, rewards are buffered per arm and
+	// only folded into the arm, and its posterior, every updateDelay rewards.
+	// The normal-gamma posterior of each arm is cached between refreshes
+	enum
+	{
+		PENDING_COUNT,
+		PENDING_VALUE,
+		PENDING_SQUARED_VALUE,
+		POSTERIOR_COUNT,
+		POSTERIOR_MEAN,
+		POSTERIOR_SCALE,	// beta1 / lambda1
+		GAMMA_D,			// Marsaglia-Tsang constants for alpha1
+		GAMMA_C,
+		NUMBER_OF_COLUMNS
+	};
+
+	void updatePosterior(const int armIndex);
+	void flush(const int armIndex);
+
 	double mu0 = 0;
 	double lambda0 = 0.01;
 	double alpha0 = 1;
@@ -251,9 +424,5 @@ private:
 	double lambda;
         int updateDelay;
 	int rewardBufferSize;
-	boost::mt19937 generator;
-	std::vector<int> counts;
-	std::vector<double> sampledMeans;
-	std::vector<double> means;
-	std::vector<double> vars;
+	std::vector<double> sampledNormals;
 };
@@ -60,6 +60,9 @@ STATE* BATTLESHIP::CreateStartState() const
 		cell.Diagonal = false;
 	}
 	bsstate->NumRemaining = 0;
+	bsstate->Legal.Resize(NumActions);
+	bsstate->Legal.SetAll();
+	bsstate->SmartLegal = bsstate->Legal;
 
 	bool found;
 	bsstate->Ships.clear();
@@ -89,6 +92,11 @@ void BATTLESHIP::FreeState(STATE* state) const
 	MemoryPool.Free(bsstate);
 }
 
+size_t BATTLESHIP::GetMemoryUsage() const
+{
+	return MemoryPool.GetMemoryUsage();
+}
+
 bool BATTLESHIP::Step(STATE& state, int action,
 	int& observation, double& reward) const
 {
@@ -115,8 +123,14 @@ bool BATTLESHIP::Step(STATE& state, int action,
 
 			// Mark four diagonals, not possible for ships to be here
 			for (int d = 4; d < 8; ++d)
-				if (bsstate.Cells.Inside(actionPos + COORD::Compass[d]))
-					bsstate.Cells(actionPos + COORD::Compass[d]).Diagonal = true;
+			{
+				COORD diagonalPos = actionPos + COORD::Compass[d];
+				if (bsstate.Cells.Inside(diagonalPos))
+				{
+					bsstate.Cells(diagonalPos).Diagonal = true;
+					bsstate.SmartLegal.Remove(bsstate.Cells.Index(diagonalPos));
+				}
+			}
 		}
 		else // miss
 		{
@@ -124,6 +138,8 @@ bool BATTLESHIP::Step(STATE& state, int action,
 			observation = 0;
 		}
 		cell.Visited = true;
+		bsstate.Legal.Remove(action);
+		bsstate.SmartLegal.Remove(action);
 	}
 
 	if (bsstate.NumRemaining == 0)
@@ -181,6 +197,8 @@ bool BATTLESHIP::LocalMove(STATE& state, const HISTORY& history,
 					bsstate.Cells(pos + COORD::Compass[d]).Diagonal = true;
 	}
 
+	if (refreshDiagonals)
+		UpdateLegal(bsstate);
 	return true;
 }
 
@@ -298,20 +316,29 @@ bool BATTLESHIP::SwitchThreeShips(BATTLESHIP_STATE& bsstate) const
 
 void BATTLESHIP::GenerateLegal(const STATE& state, const HISTORY& history,
 	vector<int>& legal, const STATUS& status) const
+{
+	LegalActions(state, status)->AppendTo(legal);
+}
+
+const ACTION_SET* BATTLESHIP::LegalActions(const STATE& state,
+	const STATUS& status) const
 {
 	const BATTLESHIP_STATE& bsstate = safe_cast<const BATTLESHIP_STATE&>(state);
 	bool diagonals = Knowledge.Level(status.Phase) == KNOWLEDGE::SMART;
 	if (diagonals)
-	{
-		for (int a = 0; a < NumActions; ++a)
-			if (!bsstate.Cells(a).Visited && !bsstate.Cells(a).Diagonal)
-				legal.push_back(a);
-	}
+		return &bsstate.SmartLegal;
 	else
+		return &bsstate.Legal;
+}
+
+void BATTLESHIP::UpdateLegal(BATTLESHIP_STATE& bsstate) const
+{
+	// Rebuild legal sets from scratch, only needed when diagonals change
+	for (int a = 0; a < NumActions; ++a)
 	{
-		for (int a = 0; a < NumActions; ++a)
-			if (!bsstate.Cells(a).Visited)
-				legal.push_back(a);
+		const BATTLESHIP_STATE::CELL& cell = bsstate.Cells(a);
+		bsstate.Legal.Set(a, !cell.Visited);
+		bsstate.SmartLegal.Set(a, !cell.Visited && !cell.Diagonal);
 	}
 }
 
@@ -26,6 +26,8 @@ public:
 	GRID<CELL> Cells;
 	std::vector<SHIP> Ships;
 	int NumRemaining;
+	ACTION_SET Legal;		// Unvisited cells, maintained by Step
+	ACTION_SET SmartLegal;	// Unvisited cells not diagonal to a hit
 };
 
 class BATTLESHIP : public SIMULATOR
@@ -36,6 +38,7 @@ public:
 
 	virtual STATE* Copy(const STATE& state) const;
 	virtual void Validate(const STATE& state) const;
+	virtual size_t GetMemoryUsage() const;
 	virtual STATE* CreateStartState() const;
 	virtual void FreeState(STATE* state) const;
 	virtual bool Step(STATE& state, int action,
@@ -43,6 +46,8 @@ public:
 
 	void GenerateLegal(const STATE& state, const HISTORY& history,
 		std::vector<int>& legal, const STATUS& status) const;
+	virtual const ACTION_SET* LegalActions(const STATE& state,
+		const STATUS& status) const;
 	virtual bool LocalMove(STATE& state, const HISTORY& history,
 		int stepObs, const STATUS& status) const;
 
@@ -1,6 +1,7 @@
 #include "beliefstate.h"
 #include "simulator.h"
 #include "utils.h"
+#include "profiler.h"
 
 using namespace UTILS;
 
@@ -21,8 +22,9 @@ void BELIEF_STATE::Free(const SIMULATOR& simulator)
 
 STATE* BELIEF_STATE::CreateSample(const SIMULATOR& simulator) const
 {
+	PROFILE(CREATE_SAMPLE);
 	int index = Random(Samples.size());
-	return simulator.Copy(*Samples[index]);
+	return PROFILED(COPY, simulator.Copy(*Samples[index]));
 }
 
 void BELIEF_STATE::AddSample(STATE* state)
@@ -35,7 +37,7 @@ void BELIEF_STATE::Copy(const BELIEF_STATE& beliefs, const SIMULATOR& simulator)
 	for (std::vector<STATE*>::const_iterator i_state = beliefs.Samples.begin();
 		i_state != beliefs.Samples.end(); ++i_state)
 	{
-		AddSample(simulator.Copy(**i_state));
+		AddSample(PROFILED(COPY, simulator.Copy(**i_state)));
 	}
 }
 
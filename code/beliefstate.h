@@ -2,6 +2,7 @@
 #define BELIEF_STATE_H
 
 #include <vector>
+#include <stddef.h>
 
 class STATE;
 class SIMULATOR;
@@ -31,6 +32,9 @@ public:
 	int GetNumSamples() const { return Samples.size(); }
 	const STATE* GetSample(int index) const { return Samples[index]; }
 
+	// Bytes of the sample vector; the states belong to the simulator's pool
+	size_t GetMemoryUsage() const { return Samples.capacity() * sizeof(STATE*); }
+
 private:
 
 	std::vector<STATE*> Samples;
@@ -0,0 +1,552 @@
+#include "battleship.h"
+#include "network.h"
+#include "pocman.h"
+#include "rocksample.h"
+#include "tag.h"
+#include "testsimulator.h"
+#include "mcts.h"
+#include "planner.h"
+#include "beliefstate.h"
+#include "utils.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace std;
+using namespace UTILS;
+
+// Compiler flags of the build, set by the Makefile
+#ifndef BENCH_FLAGS
+#define BENCH_FLAGS ""
+#endif
+
+//----------------------------------------------------------------------------
+// Microbenchmarks of the simulators, search nodes, bandits and planners.
+// Each benchmark doubles its number of iterations until one run of them
+// takes at least MinTime seconds, and reports the time per iteration of
+// that run. The results are written as one JSON document, with the
+// benchmarks in a fixed order, so that runs of different releases can be
+// compared entry by entry.
+//
+// Usage: benchmark [output file] [name filter]
+
+class BENCH
+{
+public:
+
+	typedef chrono::steady_clock CLOCK;
+
+	BENCH(double minTime, const string& filter)
+		: MinTime(minTime), Filter(filter)
+	{
+	}
+
+	// op(n) runs n iterations and returns the nanoseconds they took, so that
+	// setup and cleanup between timed sections are not counted
+	template<class OP>
+	void Run(const string& name, OP op)
+	{
+		if (name.find(Filter) == string::npos)
+			return;
+
+		RandomSeed(0);
+		long long iterations = 1;
+		double ns;
+		while (true)
+		{
+			ns = op(iterations);
+			if (ns >= MinTime * 1e9 || iterations >= (1LL << 40))
+				break;
+			iterations *= 2;
+		}
+
+		RESULT result;
+		result.Name = name;
+		result.Iterations = iterations;
+		result.NsPerOp = ns / iterations;
+		Results.push_back(result);
+		cerr << setw(48) << left << name << right
+			<< setw(14) << fixed << setprecision(1) << result.NsPerOp << " ns/op" << endl;
+	}
+
+	static double Since(const CLOCK::time_point& start)
+	{
+		return chrono::duration<double, nano>(CLOCK::now() - start).count();
+	}
+
+	void Write(ostream& ostr) const
+	{
+		ostr << "{\n";
+		ostr << "  \"schema\": 1,\n";
+		ostr << "  \"min_time\": " << MinTime << ",\n";
+		ostr << "  \"cxxflags\": \"" << BENCH_FLAGS << "\",\n";
+		ostr << "  \"benchmarks\": [";
+		for (size_t i = 0; i < Results.size(); i++)
+		{
+			const RESULT& result = Results[i];
+			ostr << (i == 0 ? "\n" : ",\n")
+				<< "    {\"name\": \"" << result.Name << "\""
+				<< ", \"iterations\": " << result.Iterations
+				<< ", \"ns_per_op\": " << fixed << setprecision(3) << result.NsPerOp << "}";
+		}
+		ostr << "\n  ]\n}\n";
+	}
+
+private:
+
+	struct RESULT
+	{
+		string Name;
+		long long Iterations;
+		double NsPerOp;
+	};
+
+	double MinTime;
+	string Filter;
+	vector<RESULT> Results;
+};
+
+// Keeps the results of benchmarked calls from being optimised away
+static volatile double Sink;
+
+// Operations that produce many objects are timed a batch at a time,
+// and the objects are released outside the timed section
+static const int BatchSize = 1024;
+
+//----------------------------------------------------------------------------
+
+// Walk a few random steps from the start state, recording the history,
+// to reach a typical state with a non-empty history
+static STATE* CreateTypicalState(const SIMULATOR& simulator, HISTORY& history)
+{
+	SIMULATOR::STATUS status;
+	STATE* state = simulator.CreateStartState();
+	for (int t = 0; t < 4; t++)
+	{
+		STATE* next = simulator.Copy(*state);
+		int action = simulator.SelectRandom(*state, history, status);
+		int observation;
+		double reward;
+		if (simulator.Step(*next, action, observation, reward))
+		{
+			simulator.FreeState(next);
+			break;
+		}
+		simulator.FreeState(state);
+		state = next;
+		history.Add(action, observation);
+	}
+	return state;
+}
+
+static void BenchSimulator(BENCH& bench, const string& name, const SIMULATOR& simulator)
+{
+	SIMULATOR::STATUS status;
+	HISTORY history;
+	RandomSeed(0);
+	STATE* typical = CreateTypicalState(simulator, history);
+
+	// Legal random actions, as in a rollout, restarting from the typical state
+	// on termination. Some domains assert on illegal actions, so the time
+	// includes SelectRandom, which is GenerateLegal and a random choice
+	bench.Run(name + "/Step", [&](long long n)
+	{
+		STATE* state = simulator.Copy(*typical);
+		int observation;
+		double reward, total = 0;
+		BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+		for (long long i = 0; i < n; i++)
+		{
+			int action = simulator.SelectRandom(*state, history, status);
+			if (simulator.Step(*state, action, observation, reward))
+			{
+				simulator.FreeState(state);
+				state = simulator.Copy(*typical);
+			}
+			total += reward;
+		}
+		double ns = BENCH::Since(start);
+		simulator.FreeState(state);
+		Sink = total;
+		return ns;
+	});
+
+	// The same rollout steps a batch of lanes at a time, timed per lane step.
+	// Domains without a native batch step each lane through Step
+	const int lanes = 16;
+	bench.Run(name + "/StepBatch_" + to_string(lanes), [&](long long n)
+	{
+		STATE_BATCH* batch = simulator.CreateBatch(lanes);
+		for (int lane = 0; lane < lanes; lane++)
+			simulator.LoadBatch(*batch, lane, *typical, history);
+		double total = 0;
+		BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+		for (long long i = 0; i < n; i += lanes)
+		{
+			simulator.SelectRandomBatch(*batch, status);
+			simulator.StepBatch(*batch);
+			for (int lane = 0; lane < lanes; lane++)
+			{
+				total += batch->Reward[lane];
+				if (batch->Terminal[lane])
+					simulator.LoadBatch(*batch, lane, *typical, history);
+			}
+		}
+		double ns = BENCH::Since(start);
+		delete batch;
+		Sink = total;
+		return ns;
+	});
+
+	bench.Run(name + "/Copy", [&](long long n)
+	{
+		vector<STATE*> states(BatchSize);
+		double ns = 0;
+		for (long long i = 0; i < n; i += BatchSize)
+		{
+			int batch = min<long long>(BatchSize, n - i);
+			BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+			for (int j = 0; j < batch; j++)
+				states[j] = simulator.Copy(*typical);
+			ns += BENCH::Since(start);
+			for (int j = 0; j < batch; j++)
+				simulator.FreeState(states[j]);
+		}
+		return ns;
+	});
+
+	bench.Run(name + "/GenerateLegal", [&](long long n)
+	{
+		vector<int> legal;
+		long long total = 0;
+		BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+		for (long long i = 0; i < n; i++)
+		{
+			legal.clear();
+			simulator.GenerateLegal(*typical, history, legal, status);
+			total += legal.size();
+		}
+		double ns = BENCH::Since(start);
+		Sink = total;
+		return ns;
+	});
+
+	bench.Run(name + "/GeneratePreferred", [&](long long n)
+	{
+		vector<int> preferred;
+		long long total = 0;
+		BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+		for (long long i = 0; i < n; i++)
+		{
+			preferred.clear();
+			simulator.GeneratePreferred(*typical, history, preferred, status);
+			total += preferred.size();
+		}
+		double ns = BENCH::Since(start);
+		Sink = total;
+		return ns;
+	});
+
+	// Repeated moves of the same state, consistent with the last observation.
+	// A rejected move may leave the state inconsistent, as AddTransforms
+	// discards it, so the state is then copied again from the typical state
+	if (history.Size() > 0)
+	{
+		bench.Run(name + "/LocalMove", [&](long long n)
+		{
+			STATE* state = simulator.Copy(*typical);
+			int stepObs = history.Back().Observation;
+			long long accepted = 0;
+			BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+			for (long long i = 0; i < n; i++)
+			{
+				if (simulator.LocalMove(*state, history, stepObs, status))
+				{
+					accepted++;
+				}
+				else
+				{
+					simulator.FreeState(state);
+					state = simulator.Copy(*typical);
+				}
+			}
+			double ns = BENCH::Since(start);
+			simulator.FreeState(state);
+			Sink = accepted;
+			return ns;
+		});
+	}
+
+	simulator.FreeState(typical);
+}
+
+//----------------------------------------------------------------------------
+
+// The generator behind every random draw of the simulators and planners
+static void BenchRandom(BENCH& bench)
+{
+	bench.Run("random/Random", [&](long long n)
+	{
+		long long sum = 0;
+		BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+		for (long long i = 0; i < n; i++)
+			sum += Random(1000);
+		double ns = BENCH::Since(start);
+		Sink = sum;
+		return ns;
+	});
+
+	bench.Run("random/Bernoulli", [&](long long n)
+	{
+		long long sum = 0;
+		BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+		for (long long i = 0; i < n; i++)
+			sum += Bernoulli(0.3);
+		double ns = BENCH::Since(start);
+		Sink = sum;
+		return ns;
+	});
+}
+
+static void BenchGreedyUCB(BENCH& bench, const MCTS::PARAMS& params)
+{
+	for (int actions = 2; actions <= 256; actions *= 4)
+	{
+		TEST_SIMULATOR simulator(actions, 2, 10);
+		MCTS mcts(simulator, params);
+
+		// Children with distinct counts and values, so no branch is trivial
+		// ExpandNode does not take the state
+		STATE* state = simulator.CreateStartState();
+		VNODE* vnode = mcts.ExpandNode(state);
+		int total = 0;
+		for (int action = 0; action < actions; action++)
+		{
+			int count = 1 + Random(100);
+			vnode->Child(action).Value.Set(count, RandomDouble(0, 1));
+			total += count;
+		}
+		vnode->Value.Set(total, 0);
+
+		bench.Run("GreedyUCB/actions_" + to_string(actions), [&](long long n)
+		{
+			long long sum = 0;
+			BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+			for (long long i = 0; i < n; i++)
+				sum += mcts.GreedyUCB(vnode, true);
+			double ns = BENCH::Since(start);
+			Sink = sum;
+			return ns;
+		});
+
+		VNODE::Free(vnode, simulator);
+		simulator.FreeState(state);
+	}
+}
+
+static void BenchBandit(BENCH& bench, const string& name, Bandit& bandit)
+{
+	vector<int> legal(bandit.getNumberOfArms());
+	for (size_t arm = 0; arm < legal.size(); arm++)
+		legal[arm] = arm;
+
+	// Some evidence on every arm, so posteriors and confidence bounds are not degenerate
+	for (size_t i = 0; i < 16 * legal.size(); i++)
+	{
+		bandit.sampleFrom(legal);
+		bandit.update(RandomDouble(0, 1));
+	}
+
+	bench.Run("bandit/" + name + "/sampleFrom", [&](long long n)
+	{
+		long long sum = 0;
+		BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+		for (long long i = 0; i < n; i++)
+			sum += bandit.sampleFrom(legal);
+		double ns = BENCH::Since(start);
+		Sink = sum;
+		return ns;
+	});
+
+	// Rewards for the last sampled arm
+	bench.Run("bandit/" + name + "/update", [&](long long n)
+	{
+		bandit.sampleFrom(legal);
+		BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+		for (long long i = 0; i < n; i++)
+			bandit.update((i & 1) ? 1.0 : 0.0);
+		return BENCH::Since(start);
+	});
+}
+
+static void BenchBandits(BENCH& bench, const MCTS::PARAMS& params)
+{
+	const int arms = 16;
+	RandomBandit random(arms);
+	EpsilonGreedy epsilonGreedy(arms, 0, 0.1);
+	UCB1 ucb(arms, 0, params.ExplorationConstant);
+	ThompsonSampling thompson(arms, 0, params.BanditUpdateDelay, params.BanditBetaPrior);
+	ThompsonSampling convergent(arms, params.BanditArmCapacity, params.BanditUpdateDelay, params.BanditBetaPrior);
+
+	BenchBandit(bench, "RandomBandit", random);
+	BenchBandit(bench, "EpsilonGreedy", epsilonGreedy);
+	BenchBandit(bench, "UCB1", ucb);
+	BenchBandit(bench, "ThompsonSampling", thompson);
+	BenchBandit(bench, "ThompsonSampling_capacity_" + to_string(params.BanditArmCapacity), convergent);
+}
+
+//----------------------------------------------------------------------------
+
+static void BenchNodes(BENCH& bench, const SIMULATOR& simulator, const MCTS::PARAMS& params)
+{
+	// Sets the node shapes for the simulator
+	MCTS mcts(simulator, params);
+
+	BELIEF_STATE beliefs;
+	for (int i = 0; i < params.NumStartStates; i++)
+		beliefs.AddSample(simulator.CreateStartState());
+
+	bench.Run("BELIEF_STATE/CreateSample", [&](long long n)
+	{
+		vector<STATE*> states(BatchSize);
+		double ns = 0;
+		for (long long i = 0; i < n; i += BatchSize)
+		{
+			int batch = min<long long>(BatchSize, n - i);
+			BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+			for (int j = 0; j < batch; j++)
+				states[j] = beliefs.CreateSample(simulator);
+			ns += BENCH::Since(start);
+			for (int j = 0; j < batch; j++)
+				simulator.FreeState(states[j]);
+		}
+		return ns;
+	});
+
+	vector<VNODE*> vnodes(BatchSize);
+
+	bench.Run("VNODE/Create", [&](long long n)
+	{
+		double ns = 0;
+		for (long long i = 0; i < n; i += BatchSize)
+		{
+			int batch = min<long long>(BatchSize, n - i);
+			BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+			for (int j = 0; j < batch; j++)
+				vnodes[j] = VNODE::Create();
+			ns += BENCH::Since(start);
+			for (int j = 0; j < batch; j++)
+				VNODE::Free(vnodes[j], simulator);
+		}
+		return ns;
+	});
+
+	bench.Run("VNODE/Free", [&](long long n)
+	{
+		double ns = 0;
+		for (long long i = 0; i < n; i += BatchSize)
+		{
+			int batch = min<long long>(BatchSize, n - i);
+			for (int j = 0; j < batch; j++)
+				vnodes[j] = VNODE::Create();
+			BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+			for (int j = 0; j < batch; j++)
+				VNODE::Free(vnodes[j], simulator);
+			ns += BENCH::Since(start);
+		}
+		return ns;
+	});
+
+	beliefs.Free(simulator);
+}
+
+//----------------------------------------------------------------------------
+
+// One decision from the initial belief of a fresh planner
+template<class PLANNER>
+static void BenchPlanner(BENCH& bench, const string& name,
+	const SIMULATOR& simulator, const MCTS::PARAMS& params)
+{
+	bench.Run("planner/" + name + "/SelectAction", [&](long long n)
+	{
+		double ns = 0;
+		long long sum = 0;
+		for (long long i = 0; i < n; i++)
+		{
+			unique_ptr<PLANNER> planner(new PLANNER(simulator, params));
+			BENCH::CLOCK::time_point start = BENCH::CLOCK::now();
+			sum += planner->SelectAction();
+			ns += BENCH::Since(start);
+		}
+		Sink = sum;
+		return ns;
+	});
+}
+
+static void BenchPlanners(BENCH& bench, const SIMULATOR& simulator, const MCTS::PARAMS& params)
+{
+	BenchPlanner<MCTS>(bench, "MCTS", simulator, params);
+	BenchPlanner<POSTS>(bench, "POSTS", simulator, params);
+	BenchPlanner<SYMBOL>(bench, "SYMBOL", simulator, params);
+	BenchPlanner<POOLTS>(bench, "POOLTS", simulator, params);
+
+	// Rollouts from the root only, one at a time and in lockstep batches
+	MCTS::PARAMS rollouts = params;
+	rollouts.DisableTree = true;
+	BenchPlanner<MCTS>(bench, "MCTS_rollouts", simulator, rollouts);
+	rollouts.BatchSize = 16;
+	BenchPlanner<MCTS>(bench, "MCTS_rollouts_batch_16", simulator, rollouts);
+
+	// The bandit stack planners with their rollouts on four threads
+	MCTS::PARAMS threaded = params;
+	threaded.NumThreads = 4;
+	BenchPlanner<POSTS>(bench, "POSTS_threads_4", simulator, threaded);
+	BenchPlanner<SYMBOL>(bench, "SYMBOL_threads_4", simulator, threaded);
+}
+
+//----------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+	// Some simulators print their setup, so the results always go to a file
+	string outputFile = argc > 1 ? argv[1] : "bench.json";
+	string filter = argc > 2 ? argv[2] : "";
+	BENCH bench(0.2, filter);
+
+	SIMULATOR::KNOWLEDGE knowledge;
+	knowledge.RolloutLevel = SIMULATOR::KNOWLEDGE::LEGAL;
+
+	MCTS::PARAMS params;
+	params.MaxDepth = 30;
+	params.NumSimulations = 1 << 10;
+	params.BanditBetaPrior = 1;
+	MCTS::InitFastUCB(params.ExplorationConstant);
+
+	BATTLESHIP battleship(10, 10, 5);
+	FULL_POCMAN pocman;
+	NETWORK network(10, NETWORK::E_CYCLE);
+	ROCKSAMPLE rocksample(7, 8);
+	ROCKSAMPLE largeRocksample(11, 11);
+	TAG tag(1);
+	SIMULATOR* simulators[] = { &battleship, &pocman, &network, &rocksample, &largeRocksample, &tag };
+	const char* names[] = { "battleship_10_10_5", "pocman", "network_10_cycle", "rocksample_7_8", "rocksample_11_11", "tag_1" };
+	for (int i = 0; i < 6; i++)
+	{
+		simulators[i]->SetKnowledge(knowledge);
+		BenchSimulator(bench, names[i], *simulators[i]);
+	}
+
+	BenchRandom(bench);
+	BenchGreedyUCB(bench, params);
+	BenchBandits(bench, params);
+
+	BenchNodes(bench, rocksample, params);
+	BenchPlanners(bench, rocksample, params);
+
+	ofstream output(outputFile.c_str());
+	bench.Write(output);
+	return 0;
+}
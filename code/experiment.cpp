@@ -1,8 +1,17 @@
 #include "experiment.h"
 #include "boost/timer.hpp"
+#include "profiler.h"
+#include "resultswriter.h"
+#include <chrono>
 
 using namespace std;
 
+// Wall-clock seconds since start
+static double Seconds(const chrono::steady_clock::time_point& start)
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
 EXPERIMENT::PARAMS::PARAMS()
 	: NumRuns(100),
 	NumSteps(100000),
@@ -15,7 +24,9 @@ EXPERIMENT::PARAMS::PARAMS()
 	Accuracy(0.01),
 	UndiscountedHorizon(1000),
 	AutoExploration(true),
-	usePOSTS(false)
+	usePOSTS(false),
+	MemoryInterval(10),
+	Problem("")
 {
 }
 
@@ -24,7 +35,7 @@ EXPERIMENT::EXPERIMENT(const SIMULATOR& real,
 	EXPERIMENT::PARAMS& expParams, MCTS::PARAMS& searchParams)
 	: Real(real),
 	Simulator(simulator),
-	OutputFile(outputFile.c_str()),
+	Output(outputFile),
 	ExpParams(expParams),
 	SearchParams(searchParams)
 {
@@ -41,6 +52,9 @@ EXPERIMENT::EXPERIMENT(const SIMULATOR& real,
 void EXPERIMENT::Run()
 {
 	boost::timer timer;
+	// Time spent sampling memory, which walks the whole tree, is not
+	// counted towards the run's time or its time out
+	double memorySeconds = 0;
 
 	MCTS* mcts = NULL;
 	if(ExpParams.usePOSTS)
@@ -58,6 +72,7 @@ void EXPERIMENT::Run()
 	bool outOfParticles = false;
 	int t;
 
+	int firstStep = Results.Reward.GetCount();
 	STATE* state = Real.CreateStartState();
 	if (SearchParams.Verbose >= 1)
 		Real.DisplayState(*state, cout);
@@ -66,7 +81,21 @@ void EXPERIMENT::Run()
 	{
 		int observation;
 		double reward;
-        int action = mcts->SelectAction();
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		double cpuStart = UTILS::ThreadCpuSeconds();
+		int action = mcts->SelectAction();
+		Results.DecisionLatency.Add(Seconds(start));
+		Results.DecisionCpuTime.Add(UTILS::ThreadCpuSeconds() - cpuStart);
+		if (ExpParams.MemoryInterval > 0 && t % ExpParams.MemoryInterval == 0)
+		{
+			boost::timer memoryTimer;
+			AddMemoryUsage(*mcts);
+			memorySeconds += memoryTimer.elapsed();
+		}
+#ifdef USE_PROFILER
+		PROFILER::Display(cout);
+		PROFILER::Clear();
+#endif
 		terminal = Real.Step(*state, action, observation, reward);
 
 		Results.Reward.Add(reward);
@@ -83,24 +112,26 @@ void EXPERIMENT::Run()
 
 		if (terminal)
 		{
-			cout << "Terminated" << endl;
+			cout << "Terminated" << "\n";
 			break;
 		}
+		start = chrono::steady_clock::now();
 		outOfParticles = !mcts->Update(action, observation, reward);
+		Results.UpdateLatency.Add(Seconds(start));
 		if (outOfParticles)
 			break;
 
-		if (timer.elapsed() > ExpParams.TimeOut)
+		if (timer.elapsed() - memorySeconds > ExpParams.TimeOut)
 		{
 			cout << "Timed out after " << t << " steps in "
-				<< Results.Time.GetTotal() << "seconds" << endl;
+				<< Results.Time.GetTotal() << "seconds" << "\n";
 			break;
 		}
 	}
 
 	if (outOfParticles)
 	{
-		cout << "Out of particles, finishing episode with SelectRandom" << endl;
+		cout << "Out of particles, finishing episode with SelectRandom" << "\n";
 		HISTORY history = mcts->GetHistory();
 		while (++t < ExpParams.NumSteps)
 		{
@@ -127,7 +158,7 @@ void EXPERIMENT::Run()
 
 			if (terminal)
 			{
-				cout << "Terminated" << endl;
+				cout << "Terminated" << "\n";
 				break;
 			}
 
@@ -135,28 +166,116 @@ void EXPERIMENT::Run()
 		}
 	}
 
-	Results.Time.Add(timer.elapsed());
+	double time = timer.elapsed() - memorySeconds;
+	Results.Time.Add(time);
 	Results.UndiscountedReturn.Add(undiscountedReturn);
 	Results.DiscountedReturn.Add(discountedReturn);
 	cout << "Discounted return = " << discountedReturn
-		<< ", average = " << Results.DiscountedReturn.GetMean() << endl;
+		<< ", average = " << Results.DiscountedReturn.GetMean() << "\n";
 	cout << "Undiscounted return = " << undiscountedReturn
-		<< ", average = " << Results.UndiscountedReturn.GetMean() << endl;
+		<< ", average = " << Results.UndiscountedReturn.GetMean() << "\n";
+
+	Output.Begin("episode");
+	Output.Add("simulations", SearchParams.NumSimulations);
+	Output.Add("run", Results.Time.GetCount());
+	Output.Add("steps", Results.Reward.GetCount() - firstStep);
+	Output.Add("terminal", terminal);
+	Output.Add("out_of_particles", outOfParticles);
+	Output.Add("undiscounted_return", undiscountedReturn);
+	Output.Add("discounted_return", discountedReturn);
+	Output.Add("time", time);
+	Output.End();
 	delete mcts;
 }
 
+void EXPERIMENT::AddMemoryUsage(const MCTS& mcts)
+{
+	MCTS::MEMORY_USAGE usage;
+	mcts.GetMemoryUsage(usage);
+	Results.TreeBytes.Add(usage.Tree);
+	Results.ParticleBytes.Add(usage.Particles);
+	Results.StateBytes.Add(usage.States);
+	Results.BanditBytes.Add(usage.Bandits);
+	Results.PeakResidentBytes.Add(UTILS::PeakResidentBytes());
+
+	const BanditStackPlanner* planner = dynamic_cast<const BanditStackPlanner*>(&mcts);
+	if (planner)
+		Results.MaxNumberOfBandits.Add(planner->getMaxNumberOfBandits());
+}
+
+void EXPERIMENT::DisplayLatency(ostream& ostr) const
+{
+	ostr << "Decision latency ms: p50 = " << Results.DecisionLatency.GetPercentile(0.5) * 1000
+		<< ", p90 = " << Results.DecisionLatency.GetPercentile(0.9) * 1000
+		<< ", p99 = " << Results.DecisionLatency.GetPercentile(0.99) * 1000
+		<< ", max = " << Results.DecisionLatency.GetMax() * 1000
+		<< ", thread CPU mean = " << Results.DecisionCpuTime.GetMean() * 1000 << "\n"
+		<< "Update latency ms: p99 = " << Results.UpdateLatency.GetPercentile(0.99) * 1000
+		<< ", max = " << Results.UpdateLatency.GetMax() * 1000 << "\n";
+}
+
+// Latency fields of a configuration record
+void EXPERIMENT::AddLatency()
+{
+	Output.Add("decision_p50_ms", Results.DecisionLatency.GetPercentile(0.5) * 1000);
+	Output.Add("decision_p90_ms", Results.DecisionLatency.GetPercentile(0.9) * 1000);
+	Output.Add("decision_p99_ms", Results.DecisionLatency.GetPercentile(0.99) * 1000);
+	Output.Add("decision_max_ms", Results.DecisionLatency.GetMax() * 1000);
+	Output.Add("decision_cpu_ms", Results.DecisionCpuTime.GetMean() * 1000);
+	Output.Add("update_p99_ms", Results.UpdateLatency.GetPercentile(0.99) * 1000);
+	Output.Add("update_max_ms", Results.UpdateLatency.GetMax() * 1000);
+}
+
+// First record of the output: what was run, and with which parameters
+void EXPERIMENT::WriteExperiment(const string& mode)
+{
+	Output.Begin("experiment");
+	Output.Add("schema", 1);
+	Output.Add("mode", mode);
+	Output.Add("problem", ExpParams.Problem);
+	Output.Add("planner", ExpParams.usePOSTS ? "POSTS" : "MCTS");
+	Output.Add("runs", ExpParams.NumRuns);
+	Output.Add("min_doubles", ExpParams.MinDoubles);
+	Output.Add("max_doubles", ExpParams.MaxDoubles);
+	Output.Add("accuracy", ExpParams.Accuracy);
+	Output.Add("undiscounted_horizon", ExpParams.UndiscountedHorizon);
+	Output.Add("max_depth", SearchParams.MaxDepth);
+	Output.Add("exploration_constant", SearchParams.ExplorationConstant);
+	Output.Add("use_transforms", SearchParams.UseTransforms);
+	Output.Add("use_rave", SearchParams.UseRave);
+	Output.Add("bandit_arm_capacity", SearchParams.BanditArmCapacity);
+	Output.Add("bandit_convergence_epsilon", SearchParams.BanditConvergenceEpsilon);
+	Output.Add("bandit_update_delay", SearchParams.BanditUpdateDelay);
+	Output.Add("bandit_beta_prior", SearchParams.BanditBetaPrior);
+	Output.Add("reuse_tree", SearchParams.ReuseTree);
+	Output.Add("num_threads", SearchParams.NumThreads);
+	Output.Add("memory_interval", ExpParams.MemoryInterval);
+	Output.End(true);
+}
+
+void EXPERIMENT::SetSimulations(int doubles)
+{
+	SearchParams.NumSimulations = 1 << doubles;
+	SearchParams.NumStartStates = 1 << doubles;
+	if (doubles + ExpParams.TransformDoubles >= 0)
+		SearchParams.NumTransforms = 1 << (doubles + ExpParams.TransformDoubles);
+	else
+		SearchParams.NumTransforms = 1;
+	SearchParams.MaxAttempts = SearchParams.NumTransforms * ExpParams.TransformAttempts;
+}
+
 void EXPERIMENT::MultiRun()
 {
 	int numberOfRuns = ExpParams.NumRuns;
 	for (int n = 0; n < numberOfRuns; n++)
 	{
 		cout << "Starting run " << n + 1 << " with "
-			<< SearchParams.NumSimulations << " simulations... " << endl;
+			<< SearchParams.NumSimulations << " simulations... " << "\n";
 		Run();
 		if (Results.Time.GetTotal() > ExpParams.TimeOut)
 		{
 			cout << "Timed out after " << n << " runs in "
-				<< Results.Time.GetTotal() << "seconds" << endl;
+				<< Results.Time.GetTotal() << "seconds" << "\n";
 			break;
 		}
 	}
@@ -164,74 +283,101 @@ void EXPERIMENT::MultiRun()
 
 void EXPERIMENT::DiscountedReturn()
 {
-	cout << "Main runs" << endl;
-	OutputFile << "Simulations\tRuns\tUndiscounted return\tUndiscounted error\tDiscounted return\tDiscounted error\tTime\n";
+	cout << "Main runs\n";
+	WriteExperiment("discounted_return");
 
 	ExpParams.SimSteps = Simulator.GetHorizon(ExpParams.Accuracy, ExpParams.UndiscountedHorizon);
 	ExpParams.NumSteps = Real.GetHorizon(ExpParams.Accuracy, ExpParams.UndiscountedHorizon);
 
 	for (int i = ExpParams.MinDoubles; i <= ExpParams.MaxDoubles; i++)
 	{
-		SearchParams.NumSimulations = 1 << i;
-		SearchParams.NumStartStates = 1 << i;
-		if (i + ExpParams.TransformDoubles >= 0)
-			SearchParams.NumTransforms = 1 << (i + ExpParams.TransformDoubles);
-		else
-			SearchParams.NumTransforms = 1;
-		SearchParams.MaxAttempts = SearchParams.NumTransforms * ExpParams.TransformAttempts;
+		SetSimulations(i);
 
 		Results.Clear();
 		MultiRun();
 
-		cout << "Simulations = " << SearchParams.NumSimulations << endl
-			<< "Runs = " << Results.Time.GetCount() << endl
+		cout << "Simulations = " << SearchParams.NumSimulations << "\n"
+			<< "Runs = " << Results.Time.GetCount() << "\n"
 			<< "Undiscounted return = " << Results.UndiscountedReturn.GetMean()
-			<< " +- " << Results.UndiscountedReturn.GetStdErr() << endl
+			<< " +- " << Results.UndiscountedReturn.GetStdErr() << "\n"
 			<< "Discounted return = " << Results.DiscountedReturn.GetMean()
-			<< " +- " << Results.DiscountedReturn.GetStdErr() << endl
-			<< "Time = " << Results.Time.GetMean() << endl;
-		OutputFile << SearchParams.NumSimulations << "\t"
-			<< Results.Time.GetCount() << "\t"
-			<< Results.UndiscountedReturn.GetMean() << "\t"
-			<< Results.UndiscountedReturn.GetStdErr() << "\t"
-			<< Results.DiscountedReturn.GetMean() << "\t"
-			<< Results.DiscountedReturn.GetStdErr() << "\t"
-			<< Results.Time.GetMean() << endl;
+			<< " +- " << Results.DiscountedReturn.GetStdErr() << "\n"
+			<< "Time = " << Results.Time.GetMean() << "\n"
+			<< "Max bytes: tree = " << (size_t) Results.TreeBytes.GetMax()
+			<< ", particles = " << (size_t) Results.ParticleBytes.GetMax()
+			<< ", states = " << (size_t) Results.StateBytes.GetMax()
+			<< ", bandits = " << (size_t) Results.BanditBytes.GetMax()
+			<< ", peak RSS = " << (size_t) Results.PeakResidentBytes.GetMax() << "\n";
+		DisplayLatency(cout);
+		cout.flush();
+
+		Output.Begin("configuration");
+		Output.Add("simulations", SearchParams.NumSimulations);
+		Output.Add("runs", Results.Time.GetCount());
+		Output.Add("undiscounted_return", Results.UndiscountedReturn.GetMean());
+		Output.Add("undiscounted_error", Results.UndiscountedReturn.GetStdErr());
+		Output.Add("discounted_return", Results.DiscountedReturn.GetMean());
+		Output.Add("discounted_error", Results.DiscountedReturn.GetStdErr());
+		Output.Add("time", Results.Time.GetMean());
+		Output.Add("max_tree_bytes", (size_t) Results.TreeBytes.GetMax());
+		Output.Add("max_particle_bytes", (size_t) Results.ParticleBytes.GetMax());
+		Output.Add("max_state_bytes", (size_t) Results.StateBytes.GetMax());
+		Output.Add("max_bandit_bytes", (size_t) Results.BanditBytes.GetMax());
+		Output.Add("max_bandits", Results.MaxNumberOfBandits.GetCount() ? (int) Results.MaxNumberOfBandits.GetMax() : 0);
+		Output.Add("peak_rss_bytes", (size_t) Results.PeakResidentBytes.GetMax());
+		AddLatency();
+		Output.End(true);
 	}
 }
 
 void EXPERIMENT::AverageReward()
 {
-	cout << "Main runs" << endl;
-	OutputFile << "Simulations\tSteps\tAverage reward\tAverage time\n";
+	cout << "Main runs\n";
+	WriteExperiment("average_reward");
 
 	ExpParams.SimSteps = Simulator.GetHorizon(ExpParams.Accuracy, ExpParams.UndiscountedHorizon);
 
 	for (int i = ExpParams.MinDoubles; i <= ExpParams.MaxDoubles; i++)
 	{
-		SearchParams.NumSimulations = 1 << i;
-		SearchParams.NumStartStates = 1 << i;
-		if (i + ExpParams.TransformDoubles >= 0)
-			SearchParams.NumTransforms = 1 << (i + ExpParams.TransformDoubles);
-		else
-			SearchParams.NumTransforms = 1;
-		SearchParams.MaxAttempts = SearchParams.NumTransforms * ExpParams.TransformAttempts;
+		SetSimulations(i);
 
 		Results.Clear();
 		Run();
 
-		cout << "Simulations = " << SearchParams.NumSimulations << endl
-			<< "Steps = " << Results.Reward.GetCount() << endl
+		cout << "Simulations = " << SearchParams.NumSimulations << "\n"
+			<< "Steps = " << Results.Reward.GetCount() << "\n"
 			<< "Average reward = " << Results.Reward.GetMean()
-			<< " +- " << Results.Reward.GetStdErr() << endl
-			<< "Average time = " << Results.Time.GetMean() / Results.Reward.GetCount() << endl;
-		OutputFile << SearchParams.NumSimulations << "\t"
-			<< Results.Reward.GetCount() << "\t"
-			<< Results.Reward.GetMean() << "\t"
-			<< Results.Reward.GetStdErr() << "\t"
-			<< Results.Time.GetMean() / Results.Reward.GetCount() << endl;
-		OutputFile.flush();
+			<< " +- " << Results.Reward.GetStdErr() << "\n"
+			<< "Average time = " << Results.Time.GetMean() / Results.Reward.GetCount() << "\n";
+		DisplayLatency(cout);
+		cout.flush();
+
+		Output.Begin("configuration");
+		Output.Add("simulations", SearchParams.NumSimulations);
+		Output.Add("steps", Results.Reward.GetCount());
+		Output.Add("average_reward", Results.Reward.GetMean());
+		Output.Add("reward_error", Results.Reward.GetStdErr());
+		Output.Add("average_time", Results.Time.GetMean() / Results.Reward.GetCount());
+		AddLatency();
+		Output.End(true);
+	}
+}
+
+// Fixed workload for throughput measurements: episodes at 2^doubles
+// simulations per decision are run until ExpParams.NumSteps decisions
+// have been made in all
+void EXPERIMENT::Throughput(int doubles)
+{
+	int numDecisions = ExpParams.NumSteps;
+	SetSimulations(doubles);
+
+	Results.Clear();
+	while (Results.DecisionLatency.GetCount() < numDecisions)
+	{
+		ExpParams.NumSteps = numDecisions - Results.DecisionLatency.GetCount();
+		Run();
 	}
+	ExpParams.NumSteps = numDecisions;
 }
 
 //----------------------------------------------------------------------------
@@ -4,8 +4,9 @@
 #include "mcts.h"
 #include "simulator.h"
 #include "statistic.h"
-#include <fstream>
+#include <string>
 #include "planner.h"
+#include "resultswriter.h"
 
 //----------------------------------------------------------------------------
 
@@ -18,6 +19,20 @@ struct RESULTS
 	STATISTIC DiscountedReturn;
 	STATISTIC UndiscountedReturn;
     STATISTIC MaxNumberOfBandits;
+
+	// Bytes of each part of the planner, sampled after every decision
+	STATISTIC TreeBytes;
+	STATISTIC ParticleBytes;
+	STATISTIC StateBytes;
+	STATISTIC BanditBytes;
+	STATISTIC PeakResidentBytes;
+
+	// Wall-clock seconds of each SelectAction and Update. Time is process
+	// CPU time, which adds up every rollout thread, so the CPU time of the
+	// deciding thread is kept alongside the latencies
+	HISTOGRAM DecisionLatency;
+	HISTOGRAM UpdateLatency;
+	STATISTIC DecisionCpuTime;
 };
 
 inline void RESULTS::Clear()
@@ -26,6 +41,15 @@ inline void RESULTS::Clear()
 	Reward.Clear();
 	DiscountedReturn.Clear();
 	UndiscountedReturn.Clear();
+	MaxNumberOfBandits.Clear();
+	TreeBytes.Clear();
+	ParticleBytes.Clear();
+	StateBytes.Clear();
+	BanditBytes.Clear();
+	PeakResidentBytes.Clear();
+	DecisionLatency.Clear();
+	UpdateLatency.Clear();
+	DecisionCpuTime.Clear();
 }
 
 //----------------------------------------------------------------------------
@@ -49,6 +73,8 @@ public:
 		int UndiscountedHorizon;
 		bool AutoExploration;
 		bool usePOSTS;
+		int MemoryInterval;		// Decisions between planner memory samples, 0 for none
+		std::string Problem;	// Recorded in the output, as given on the command line
 	};
 
 	EXPERIMENT(const SIMULATOR& real, const SIMULATOR& simulator,
@@ -59,16 +85,25 @@ public:
 	void MultiRun();
 	void DiscountedReturn();
 	void AverageReward();
+	void Throughput(int doubles);
+
+	const RESULTS& GetResults() const { return Results; }
 
 private:
 
+	void SetSimulations(int doubles);
+	void DisplayLatency(std::ostream& ostr) const;
+	void AddLatency();
+	void WriteExperiment(const std::string& mode);
+	void AddMemoryUsage(const MCTS& mcts);
+
 	const SIMULATOR& Real;
 	const SIMULATOR& Simulator;
 	EXPERIMENT::PARAMS& ExpParams;
 	MCTS::PARAMS& SearchParams;
 	RESULTS Results;
 
-	std::ofstream OutputFile;
+	RESULTS_WRITER Output;
 };
 
 //----------------------------------------------------------------------------
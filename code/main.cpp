@@ -4,6 +4,7 @@
 #include "pocman.h"
 #include "rocksample.h"
 #include "tag.h"
+#include "tabularpomdp.h"
 #include "experiment.h"
 #include <string>
 #include <boost/program_options.hpp>
@@ -39,6 +40,9 @@ int main(int argc, char* argv[])
 	}
 	else if(problem == "network")
 	{
+		// Number of machines and topology (0 = cycle, 1 = 3 legs)
+		size = argc > 4 ? stoi(argv[4]) : 10;
+		number = argc > 5 ? stoi(argv[5]) : NETWORK::E_CYCLE;
 		real = new NETWORK(size, number);
 		simulator = new NETWORK(size, number);
 	}
@@ -64,8 +68,29 @@ int main(int argc, char* argv[])
 	}
 	else if(problem == "tag")
 	{
-		real = new TAG(1);
-		simulator = new TAG(1);
+		// Number of opponents and optional map file
+		number = argc > 4 ? stoi(argv[4]) : 1;
+		if (argc > 5)
+		{
+			real = new TAG(number, argv[5]);
+			simulator = new TAG(number, argv[5]);
+		}
+		else
+		{
+			real = new TAG(number);
+			simulator = new TAG(number);
+		}
+	}
+	else if(problem == "pomdp")
+	{
+		// Explicit model in Cassandra's .pomdp format
+		if (argc < 5)
+		{
+			cout << "Usage: main pomdp <horizon> <beta prior> <model file>" << endl;
+			exit(1);
+		}
+		real = new TABULAR_POMDP(argv[4]);
+		simulator = new TABULAR_POMDP(argv[4]);
 	}
 	else
 	{
@@ -74,15 +99,31 @@ int main(int argc, char* argv[])
 	}
     searchParams = MCTS::PARAMS();
 	expParams = EXPERIMENT::PARAMS();
-    outputfile = problem + "_POSTS_legal_prior-"+banditBetaPriorString+"_horizon-"+horizonString+".txt";
+    outputfile = problem + "_POSTS_legal_prior-"+banditBetaPriorString+"_horizon-"+horizonString;
 	if(problem == "rocksample") 
 	{
         string problemSize = argv[4];
 		outputfile += ".";
 		outputfile += problemSize;
-		cout << "OUTPUT: " << outputfile << endl;
 	}
+	else if(problem == "tag" && argc > 4)
+	{
+		outputfile += ".";
+		outputfile += to_string(number);
+	}
+	else if(problem == "network")
+	{
+		outputfile += ".";
+		outputfile += to_string(size);
+		outputfile += ".";
+		outputfile += to_string(number);
+	}
+	outputfile += ".jsonl";
+	cout << "OUTPUT: " << outputfile << endl;
     searchParams.MaxDepth = stoi(horizonString);
+	searchParams.BanditBetaPrior = stoi(banditBetaPriorString);
+	for (int i = 1; i < argc; i++)
+		expParams.Problem += (i > 1 ? " " : "") + string(argv[i]);
     simulator->SetKnowledge(knowledge);
 	EXPERIMENT experiment(*real,*simulator, outputfile, expParams, searchParams);
 	experiment.DiscountedReturn();
@@ -1,5 +1,6 @@
 #include "mcts.h"
 #include "testsimulator.h"
+#include "profiler.h"
 #include <math.h>
 
 #include <algorithm>
@@ -21,11 +22,25 @@ MCTS::PARAMS::PARAMS()
 	EnsembleSize(4),
     BanditArmCapacity(10),
     BanditConvergenceEpsilon(0.01),
+    BanditUpdateDelay(1),
+	BanditBetaPrior(1),
 	ExplorationConstant(1),
 	UseRave(false),
 	RaveDiscount(1.0),
 	RaveConstant(0.01),
-	DisableTree(false)
+	DisableTree(false),
+	BatchSize(1),
+	ReuseTree(false),
+	ReuseDecay(1.0),
+	NumThreads(1),
+	SyncInterval(16),
+	TruncationLookahead(-1),
+	TruncationProbeInterval(10),
+	WideningConstant(0),
+	WideningExponent(0.5),
+	WideningRoute(false),
+	MaxNodes(0),
+	EvictNodes(false)
 {
 }
 
@@ -45,7 +60,7 @@ MCTS::MCTS(const SIMULATOR& simulator, const PARAMS& params)
 
 MCTS::~MCTS()
 {
-	VNODE::Free(Root, Simulator);
+	PROFILED(FREE_NODE, VNODE::Free(Root, Simulator));
 	VNODE::FreeAll();
 }
 
@@ -88,7 +103,7 @@ bool MCTS::Update(int action, int observation, double reward)
 		state = beliefs.GetSample(0);
 
 	// Delete old tree and create new root
-	VNODE::Free(Root, Simulator);
+	PROFILED(FREE_NODE, VNODE::Free(Root, Simulator));
 	VNODE* newRoot = ExpandNode(state);
 	newRoot->Beliefs() = beliefs;
 	Root = newRoot;
@@ -111,7 +126,13 @@ void MCTS::RolloutSearch()
 	std::vector<int> legal;
 	assert(BeliefState().GetNumSamples() > 0);
 	Simulator.GenerateLegal(*BeliefState().GetSample(0), GetHistory(), legal, GetStatus());
-	random_shuffle(legal.begin(), legal.end());
+	random_shuffle(legal.begin(), legal.end(), [](int n) { return Random(n); });
+
+	if (Params.BatchSize > 1)
+	{
+		BatchRolloutSearch(legal);
+		return;
+	}
 
 	for (int i = 0; i < Params.NumSimulations; i++)
 	{
@@ -121,7 +142,7 @@ void MCTS::RolloutSearch()
 
 		int observation;
 		double immediateReward, delayedReward, totalReward;
-		bool terminal = Simulator.Step(*state, action, observation, immediateReward);
+		bool terminal = PROFILED(STEP, Simulator.Step(*state, action, observation, immediateReward));
 
 		VNODE*& vnode = Root->Child(action).Child(observation);
 		if (!vnode && !terminal)
@@ -135,11 +156,75 @@ void MCTS::RolloutSearch()
 		totalReward = immediateReward + Simulator.GetDiscount() * delayedReward;
 		Root->Child(action).Value.Add(totalReward);
 
-		Simulator.FreeState(state);
+		PROFILED(FREE_STATE, Simulator.FreeState(state));
 		History.Truncate(historyDepth);
 	}
 }
 
+void MCTS::BatchRolloutSearch(const vector<int>& legal)
+{
+	// Rollouts are run BatchSize at a time in lockstep through StepBatch
+	int historyDepth = History.Size();
+	STATE_BATCH* batch = Simulator.CreateBatch(Params.BatchSize);
+	vector<int> firstAction(batch->Size);
+	vector<double> immediateReward(batch->Size), delayedReward(batch->Size),
+		discount(batch->Size);
+
+	for (int i = 0; i < Params.NumSimulations; i += batch->Size)
+	{
+		// First step is taken individually, so that new children of the root
+		// receive a sample of the state
+		int numLanes = min(batch->Size, Params.NumSimulations - i);
+		for (int lane = 0; lane < numLanes; lane++)
+		{
+			int action = legal[(i + lane) % legal.size()];
+			STATE* state = Root->Beliefs().CreateSample(Simulator);
+			Simulator.Validate(*state);
+
+			int observation;
+			bool terminal = PROFILED(STEP, Simulator.Step(*state, action, observation,
+				immediateReward[lane]));
+
+			VNODE*& vnode = Root->Child(action).Child(observation);
+			if (!vnode && !terminal)
+			{
+				vnode = ExpandNode(state);
+				AddSample(vnode, *state);
+			}
+
+			History.Add(action, observation);
+			Simulator.LoadBatch(*batch, lane, *state, History);
+			History.Truncate(historyDepth);
+			batch->Terminal[lane] = terminal;
+			firstAction[lane] = action;
+			delayedReward[lane] = 0;
+			discount[lane] = 1.0;
+			PROFILED(FREE_STATE, Simulator.FreeState(state));
+		}
+		for (int lane = numLanes; lane < batch->Size; lane++)
+			batch->Terminal[lane] = true;
+
+		Status.Phase = SIMULATOR::STATUS::ROLLOUT;
+		for (int numSteps = 0; numSteps + TreeDepth < Params.MaxDepth
+			&& !batch->AllTerminal(); ++numSteps)
+		{
+			Simulator.SelectRandomBatch(*batch, Status);
+			Simulator.StepBatch(*batch);
+			for (int lane = 0; lane < numLanes; lane++)
+			{
+				delayedReward[lane] += batch->Reward[lane] * discount[lane];
+				discount[lane] *= Simulator.GetDiscount();
+			}
+		}
+
+		for (int lane = 0; lane < numLanes; lane++)
+			Root->Child(firstAction[lane]).Value.Add(immediateReward[lane]
+				+ Simulator.GetDiscount() * delayedReward[lane]);
+	}
+
+	delete batch;
+}
+
 void MCTS::UCTSearch()
 {
 	ClearStatistics();
@@ -156,6 +241,9 @@ void MCTS::UCTSearch()
 			Simulator.DisplayState(*state, cout);
 		}
 
+		if (Params.EvictNodes && NodeBudgetReached())
+			EvictLeaves();
+
 		TreeDepth = 0;
 		PeakTreeDepth = 0;
 		double totalReward = SimulateV(*state, Root);
@@ -167,7 +255,7 @@ void MCTS::UCTSearch()
 		if (Params.Verbose >= 3)
 			DisplayValue(4, cout);
 
-		Simulator.FreeState(state);
+		PROFILED(FREE_STATE, Simulator.FreeState(state));
 		History.Truncate(historyDepth);
 	}
 
@@ -192,14 +280,47 @@ double MCTS::SimulateV(STATE& state, VNODE* vnode)
 	return totalReward;
 }
 
+// Double progressive widening: a qnode visited n times has at most
+// WideningConstant * n^WideningExponent children. Beyond that, an unseen
+// observation is either rolled out or, with WideningRoute, sent to an
+// existing child chosen in proportion to its visits. The children of the
+// root are exempt, as Update hands their beliefs on to the next root
+VNODE* MCTS::WidenOrRoute(STATE& state, QNODE& qnode, int observation)
+{
+	double limit = Params.WideningConstant
+		* pow(qnode.Value.GetCount() + 1.0, Params.WideningExponent);
+	if (qnode.Widened.size() < limit)
+	{
+		VNODE* vnode = ExpandNode(&state);
+		qnode.Child(observation) = vnode;
+		qnode.Widened.push_back(observation);
+		return vnode;
+	}
+	if (!Params.WideningRoute || qnode.Widened.empty())
+		return 0;
+
+	int totalCount = 0;
+	for (size_t i = 0; i < qnode.Widened.size(); i++)
+		totalCount += qnode.Child(qnode.Widened[i])->Value.GetCount() + 1;
+	int sample = Random(totalCount);
+	for (size_t i = 0; i < qnode.Widened.size(); i++)
+	{
+		VNODE* vnode = qnode.Child(qnode.Widened[i]);
+		sample -= vnode->Value.GetCount() + 1;
+		if (sample < 0)
+			return vnode;
+	}
+	return qnode.Child(qnode.Widened.back());
+}
+
 double MCTS::SimulateQ(STATE& state, QNODE& qnode, int action)
 {
 	int observation;
 	double immediateReward, delayedReward = 0;
 
 	if (Simulator.HasAlpha())
-		Simulator.UpdateAlpha(qnode, state);
-	bool terminal = Simulator.Step(state, action, observation, immediateReward);
+		Simulator.UpdateAlpha(qnode, state, action);
+	bool terminal = PROFILED(STEP, Simulator.Step(state, action, observation, immediateReward));
 	assert(observation >= 0 && observation < Simulator.GetNumObservations());
 	History.Add(action, observation);
 
@@ -211,9 +332,15 @@ double MCTS::SimulateQ(STATE& state, QNODE& qnode, int action)
 		Simulator.DisplayState(state, cout);
 	}
 
-	VNODE*& vnode = qnode.Child(observation);
-	if (!vnode && !terminal && qnode.Value.GetCount() >= Params.ExpandCount)
-		vnode = ExpandNode(&state);
+	VNODE* vnode = qnode.Child(observation);
+	if (!vnode && !terminal && qnode.Value.GetCount() >= Params.ExpandCount
+		&& (TreeDepth == 0 || !NodeBudgetReached()))
+	{
+		if (Params.WideningConstant > 0 && TreeDepth > 0)
+			vnode = WidenOrRoute(state, qnode, observation);
+		else
+			vnode = qnode.Child(observation) = ExpandNode(&state);
+	}
 
 	if (!terminal)
 	{
@@ -241,11 +368,102 @@ void MCTS::AddRave(VNODE* vnode, double totalReward)
 	}
 }
 
+// With a MaxNodes budget, nodes below the root's children are only expanded
+// while the tree is under budget; the children themselves always are, as
+// Update hands their beliefs on to the next root. The count is that of the
+// shared node pool
+bool MCTS::NodeBudgetReached() const
+{
+	return Params.MaxNodes > 0 && VNODE::GetNumAllocated() >= Params.MaxNodes;
+}
+
+// Free the least visited leaves, with their particles, until the tree
+// is an eighth under budget or there are no more leaves below the root's
+// children, which are kept for Update to hand on to the next root.
+// Only called between simulations, so no leaf is on the current path
+void MCTS::EvictLeaves()
+{
+	Leaves.clear();
+	for (int action = 0; action < Simulator.GetNumActions(); action++)
+	{
+		QNODE& qnode = Root->Child(action);
+		for (int observation = 0; observation < Simulator.GetNumObservations(); observation++)
+		{
+			VNODE* child = qnode.Child(observation);
+			if (child)
+				CollectLeaves(child);
+		}
+	}
+
+	int numEvicted = VNODE::GetNumAllocated() - (Params.MaxNodes - Params.MaxNodes / 8);
+	numEvicted = min(numEvicted, (int) Leaves.size());
+	if (numEvicted <= 0)
+		return;
+	nth_element(Leaves.begin(), Leaves.begin() + numEvicted - 1, Leaves.end());
+	for (int i = 0; i < numEvicted; i++)
+	{
+		QNODE& qnode = *Leaves[i].Parent;
+		VNODE*& vnode = qnode.Child(Leaves[i].Observation);
+		PROFILED(FREE_NODE, VNODE::Free(vnode, Simulator));
+		vnode = 0;
+		vector<int>::iterator widened = find(qnode.Widened.begin(),
+			qnode.Widened.end(), Leaves[i].Observation);
+		if (widened != qnode.Widened.end())
+			qnode.Widened.erase(widened);
+	}
+}
+
+// Gather the leaves below vnode, returns false if vnode is a leaf itself
+bool MCTS::CollectLeaves(VNODE* vnode)
+{
+	bool internal = false;
+	for (int action = 0; action < Simulator.GetNumActions(); action++)
+	{
+		QNODE& qnode = vnode->Child(action);
+		for (int observation = 0; observation < Simulator.GetNumObservations(); observation++)
+		{
+			VNODE* child = qnode.Child(observation);
+			if (!child)
+				continue;
+			internal = true;
+			if (!CollectLeaves(child))
+			{
+				LEAF leaf = { child->Value.GetCount(), &qnode, observation };
+				Leaves.push_back(leaf);
+			}
+		}
+	}
+	return internal;
+}
+
+void MCTS::GetMemoryUsage(MEMORY_USAGE& usage) const
+{
+	usage.Tree = VNODE::GetPoolMemoryUsage();
+	usage.Particles = 0;
+	AddNodeMemoryUsage(Root, usage);
+	usage.States = Simulator.GetMemoryUsage();
+	usage.Bandits = 0;
+}
+
+void MCTS::AddNodeMemoryUsage(const VNODE* vnode, MEMORY_USAGE& usage) const
+{
+	usage.Tree += vnode->GetHeapMemoryUsage();
+	usage.Particles += vnode->Beliefs().GetMemoryUsage();
+	for (int action = 0; action < Simulator.GetNumActions(); action++)
+	{
+		const QNODE& qnode = vnode->Child(action);
+		for (int observation = 0; observation < Simulator.GetNumObservations(); observation++)
+			if (qnode.Child(observation))
+				AddNodeMemoryUsage(qnode.Child(observation), usage);
+	}
+}
+
 VNODE* MCTS::ExpandNode(const STATE* state)
 {
+	PROFILE(EXPAND_NODE);
 	VNODE* vnode = VNODE::Create();
 	vnode->Value.Set(0, 0);
-	Simulator.Prior(state, History, vnode, Status);
+	PROFILED(PRIOR, Simulator.Prior(state, History, vnode, Status));
 
 	if (Params.Verbose >= 2)
 	{
@@ -259,7 +477,7 @@ VNODE* MCTS::ExpandNode(const STATE* state)
 
 void MCTS::AddSample(VNODE* node, const STATE& state)
 {
-	STATE* sample = Simulator.Copy(state);
+	STATE* sample = PROFILED(COPY, Simulator.Copy(state));
 	node->Beliefs().AddSample(sample);
 	if (Params.Verbose >= 2)
 	{
@@ -270,6 +488,7 @@ void MCTS::AddSample(VNODE* node, const STATE& state)
 
 int MCTS::GreedyUCB(VNODE* vnode, bool ucb) const
 {
+	PROFILE(GREEDY_UCB);
 	static vector<int> besta;
 	besta.clear();
 	double bestq = -Infinity;
@@ -319,6 +538,7 @@ int MCTS::GreedyUCB(VNODE* vnode, bool ucb) const
 
 double MCTS::Rollout(STATE& state)
 {
+	PROFILE(ROLLOUT);
 	Status.Phase = SIMULATOR::STATUS::ROLLOUT;
 	if (Params.Verbose >= 3)
 		cout << "Starting rollout" << endl;
@@ -333,7 +553,7 @@ double MCTS::Rollout(STATE& state)
 		double reward;
 
 		int action = Simulator.SelectRandom(state, History, Status);
-		terminal = Simulator.Step(state, action, observation, reward);
+		terminal = PROFILED(STEP, Simulator.Step(state, action, observation, reward));
 		History.Add(action, observation);
 
 		if (Params.Verbose >= 4)
@@ -357,6 +577,7 @@ double MCTS::Rollout(STATE& state)
 
 void MCTS::AddTransforms(VNODE* root, BELIEF_STATE& beliefs)
 {
+	PROFILE(ADD_TRANSFORMS);
 	int attempts = 0, added = 0;
 
 	// Local transformations of state that are consistent with history
@@ -384,10 +605,10 @@ STATE* MCTS::CreateTransform() const
 	double stepReward;
 
 	STATE* state = Root->Beliefs().CreateSample(Simulator);
-	Simulator.Step(*state, History.Back().Action, stepObs, stepReward);
-	if (Simulator.LocalMove(*state, History, stepObs, Status))
+	PROFILED(STEP, Simulator.Step(*state, History.Back().Action, stepObs, stepReward));
+	if (PROFILED(LOCAL_MOVE, Simulator.LocalMove(*state, History, stepObs, Status)))
 		return state;
-	Simulator.FreeState(state);
+	PROFILED(FREE_STATE, Simulator.FreeState(state));
 	return 0;
 }
 
@@ -24,12 +24,36 @@ public:
 		int EnsembleSize;
         int BanditArmCapacity;
         double BanditConvergenceEpsilon;
+        int BanditUpdateDelay;
 		int BanditBetaPrior;
 		double ExplorationConstant;
 		bool UseRave;
 		double RaveDiscount;
 		double RaveConstant;
 		bool DisableTree;
+		int BatchSize;
+		bool ReuseTree;
+		double ReuseDecay;
+		int NumThreads;
+		int SyncInterval;
+		int TruncationLookahead;
+		int TruncationProbeInterval;
+		double WideningConstant;
+		double WideningExponent;
+		bool WideningRoute;
+		int MaxNodes;
+		bool EvictNodes;
+	};
+
+	// Bytes held by each part of the planner
+	struct MEMORY_USAGE
+	{
+		MEMORY_USAGE() : Tree(0), Particles(0), States(0), Bandits(0) { }
+
+		size_t Tree;		// Node pool chunks and the vectors of each node
+		size_t Particles;	// Belief state vectors of each node
+		size_t States;		// Simulator's state pool
+		size_t Bandits;		// Bandit stacks and POOLTS arenas
 	};
 
 	MCTS(const SIMULATOR& simulator, const PARAMS& params);
@@ -40,6 +64,7 @@ public:
 
 	void UCTSearch();
 	void RolloutSearch();
+	void BatchRolloutSearch(const std::vector<int>& legal);
 
 	double Rollout(STATE& state);
 
@@ -48,6 +73,7 @@ public:
 	const SIMULATOR::STATUS& GetStatus() const { return Status; }
 	void ClearStatistics();
 	void DisplayStatistics(std::ostream& ostr) const;
+	virtual void GetMemoryUsage(MEMORY_USAGE& usage) const;
 	void DisplayValue(int depth, std::ostream& ostr) const;
 	void DisplayPolicy(int depth, std::ostream& ostr) const;
 
@@ -58,10 +84,14 @@ public:
 	int SelectRandom() const;
 	double SimulateV(STATE& state, VNODE* vnode);
 	double SimulateQ(STATE& state, QNODE& qnode, int action);
+	VNODE* WidenOrRoute(STATE& state, QNODE& qnode, int observation);
+	bool NodeBudgetReached() const;
+	void EvictLeaves();
 	void AddRave(VNODE* vnode, double totalReward);
 	VNODE* ExpandNode(const STATE* state);
 	void AddSample(VNODE* node, const STATE& state);
 	void AddTransforms(VNODE* root, BELIEF_STATE& beliefs);
+	void AddNodeMemoryUsage(const VNODE* vnode, MEMORY_USAGE& usage) const;
 	STATE* CreateTransform() const;
 	void Resample(BELIEF_STATE& beliefs);
 
@@ -81,6 +111,20 @@ public:
 	STATISTIC StatRolloutDepth;
 	STATISTIC StatTotalReward;
 private:
+
+	// Leaf of the search tree, by the slot that points to it
+	struct LEAF
+	{
+		int Count;
+		QNODE* Parent;
+		int Observation;
+
+		bool operator<(const LEAF& leaf) const { return Count < leaf.Count; }
+	};
+
+	bool CollectLeaves(VNODE* vnode);
+	std::vector<LEAF> Leaves;
+
 	static void UnitTestGreedy();
 	static void UnitTestUCB();
 	static void UnitTestRollout();
@@ -75,6 +75,14 @@ public:
 
 	int GetNumAllocated() const { return NumAllocated; }
 
+	// Bytes held by the chunks and the free list, whether allocated or not
+	size_t GetMemoryUsage() const
+	{
+		return Chunks.size() * sizeof(CHUNK)
+			+ Chunks.capacity() * sizeof(CHUNK*)
+			+ FreeList.capacity() * sizeof(T*);
+	}
+
 private:
 
 	struct CHUNK
@@ -6,6 +6,8 @@ using namespace UTILS;
 
 NETWORK::NETWORK(int numMachines, int ntype)
 	: NumMachines(numMachines),
+	NumWords((numMachines + 63) / 64),
+	NetworkType(ntype),
 	FailureProb1(0.1),
 	FailureProb2(0.333),
 	ObsProb(0.95)
@@ -14,6 +16,8 @@ NETWORK::NETWORK(int numMachines, int ntype)
 	NumObservations = 3;
 	RewardRange = NumMachines * 2;
 	Discount = 0.95;
+	AllActions.Resize(NumActions);
+	AllActions.SetAll();
 
 	switch (ntype)
 	{
@@ -23,35 +27,171 @@ NETWORK::NETWORK(int numMachines, int ntype)
 	case E_3LEGS:
 		Make3LegsNeighbours();
 		break;
+	default:
+		NeighbourStart.assign(NumMachines + 1, 0);
+		break;
 	}
+	MakeMasks();
 }
 
 void NETWORK::MakeRingNeighbours()
 {
-	Neighbours.resize(NumMachines);
+	NeighbourStart.clear();
+	NeighbourIndex.clear();
 	for (int i = 0; i < NumMachines; ++i)
 	{
-		Neighbours[i].push_back((i + 1) % NumMachines);
-		Neighbours[i].push_back((i + NumMachines - 1) % NumMachines);
+		NeighbourStart.push_back(NeighbourIndex.size());
+		NeighbourIndex.push_back((i + 1) % NumMachines);
+		NeighbourIndex.push_back((i + NumMachines - 1) % NumMachines);
 	}
+	NeighbourStart.push_back(NeighbourIndex.size());
 }
 
 void NETWORK::Make3LegsNeighbours()
 {
 	assert(NumMachines >= 4 && NumMachines % 3 == 1);
-	Neighbours.resize(NumMachines);
-	Neighbours[0].push_back(1);
-	Neighbours[0].push_back(2);
-	Neighbours[0].push_back(3);
+	NeighbourStart.clear();
+	NeighbourIndex.clear();
+	NeighbourStart.push_back(NeighbourIndex.size());
+	NeighbourIndex.push_back(1);
+	NeighbourIndex.push_back(2);
+	NeighbourIndex.push_back(3);
 	for (int i = 1; i < NumMachines; ++i)
 	{
+		NeighbourStart.push_back(NeighbourIndex.size());
 		if (i < NumMachines - 3)
-			Neighbours[i].push_back(i + 3);
+			NeighbourIndex.push_back(i + 3);
 		if (i <= 4)
-			Neighbours[i].push_back(0);
+			NeighbourIndex.push_back(0);
+		else
+			NeighbourIndex.push_back(i - 3);
+	}
+	NeighbourStart.push_back(NeighbourIndex.size());
+}
+
+void NETWORK::MakeMasks()
+{
+	ValidMask.assign(NumWords, 0);
+	ServerMask.assign(NumWords, 0);
+	for (int i = 0; i < NumMachines; ++i)
+	{
+		ValidMask[i >> 6] |= uint64_t(1) << (i & 63);
+		if (NeighbourStart[i + 1] - NeighbourStart[i] > 2)
+			ServerMask[i >> 6] |= uint64_t(1) << (i & 63);
+	}
+}
+
+// Bit i of dst becomes bit i + shift of src (zero filled)
+static void ShiftDown(const vector<uint64_t>& src, vector<uint64_t>& dst, int shift)
+{
+	assert(shift > 0 && shift < 64);
+	int n = src.size();
+	for (int w = 0; w < n; ++w)
+	{
+		uint64_t carry = w + 1 < n ? src[w + 1] << (64 - shift) : 0;
+		dst[w] = (src[w] >> shift) | carry;
+	}
+}
+
+// Bit i of dst becomes bit i - shift of src (zero filled)
+static void ShiftUp(const vector<uint64_t>& src, vector<uint64_t>& dst, int shift)
+{
+	assert(shift > 0 && shift < 64);
+	int n = src.size();
+	for (int w = n - 1; w >= 0; --w)
+	{
+		uint64_t carry = w > 0 ? src[w - 1] >> (64 - shift) : 0;
+		dst[w] = (src[w] << shift) | carry;
+	}
+}
+
+static inline bool TestBit(const vector<uint64_t>& bits, int i)
+{
+	return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void SetBit(vector<uint64_t>& bits, int i)
+{
+	bits[i >> 6] |= uint64_t(1) << (i & 63);
+}
+
+void NETWORK::NeighbourFailure(const vector<uint64_t>& failed,
+	vector<uint64_t>& neighbourFailed) const
+{
+	// Failed bits beyond NumMachines must be clear
+	static thread_local vector<uint64_t> shifted;
+	shifted.resize(NumWords);
+
+	switch (NetworkType)
+	{
+	case E_CYCLE:
+		// Neighbours i + 1 and i - 1, wrapping around the ring
+		ShiftDown(failed, neighbourFailed, 1);
+		ShiftUp(failed, shifted, 1);
+		for (int w = 0; w < NumWords; ++w)
+			neighbourFailed[w] |= shifted[w];
+		if (TestBit(failed, 0))
+			SetBit(neighbourFailed, NumMachines - 1);
+		if (TestBit(failed, NumMachines - 1))
+			SetBit(neighbourFailed, 0);
+		break;
+
+	case E_3LEGS:
+		// Neighbour i + 3 along each leg, i - 3 towards the hub for i > 4,
+		// and the hub itself for machines 1 to 4
+		ShiftDown(failed, neighbourFailed, 3);
+		ShiftUp(failed, shifted, 3);
+		shifted[0] &= ~uint64_t(0x1F);
+		for (int w = 0; w < NumWords; ++w)
+			neighbourFailed[w] |= shifted[w];
+		if (TestBit(failed, 0))
+			neighbourFailed[0] |= 0x1E;
+		if (TestBit(failed, 1) || TestBit(failed, 2) || TestBit(failed, 3))
+			neighbourFailed[0] |= 1;
 		else
-			Neighbours[i].push_back(i - 3);
+			neighbourFailed[0] &= ~uint64_t(1);
+		break;
+
+	default:
+		for (int w = 0; w < NumWords; ++w)
+			neighbourFailed[w] = 0;
+		for (int i = 0; i < NumMachines; ++i)
+			for (int j = NeighbourStart[i]; j < NeighbourStart[i + 1]; ++j)
+				if (TestBit(failed, NeighbourIndex[j]))
+					SetBit(neighbourFailed, i);
+		break;
+	}
+
+	for (int w = 0; w < NumWords; ++w)
+		neighbourFailed[w] &= ValidMask[w];
+}
+
+// NeighbourFailure for networks of at most 64 machines
+uint64_t NETWORK::NeighbourFailureWord(uint64_t failed) const
+{
+	uint64_t neighbourFailed;
+	switch (NetworkType)
+	{
+	case E_CYCLE:
+		neighbourFailed = (failed >> 1) | (failed << 1)
+			| ((failed & 1) << (NumMachines - 1))
+			| ((failed >> (NumMachines - 1)) & 1);
+		break;
+
+	case E_3LEGS:
+		neighbourFailed = (failed >> 3) | ((failed << 3) & ~uint64_t(0x1F))
+			| (-(failed & 1) & 0x1E);
+		neighbourFailed = (neighbourFailed & ~uint64_t(1)) | ((failed & 0xE) != 0);
+		break;
+
+	default:
+		neighbourFailed = 0;
+		for (int i = 0; i < NumMachines; ++i)
+			for (int j = NeighbourStart[i]; j < NeighbourStart[i + 1]; ++j)
+				neighbourFailed |= ((failed >> NeighbourIndex[j]) & 1) << i;
+		break;
 	}
+	return neighbourFailed & ValidMask[0];
 }
 
 STATE* NETWORK::Copy(const STATE& state) const
@@ -65,14 +205,15 @@ STATE* NETWORK::Copy(const STATE& state) const
 void NETWORK::Validate(const STATE& state) const
 {
 	const NETWORK_STATE& nstate = safe_cast<const NETWORK_STATE&>(state);
-	// what to validate?
+	assert((int) nstate.Machines.size() == NumWords);
+	for (int w = 0; w < NumWords; ++w)
+		assert((nstate.Machines[w] & ~ValidMask[w]) == 0);
 }
 
 STATE* NETWORK::CreateStartState() const
 {
 	NETWORK_STATE* nstate = MemoryPool.Allocate();
-	for (int i = 0; i < NumMachines; i++)
-		nstate->Machines.push_back(true);
+	nstate->Machines = ValidMask;
 	return nstate;
 }
 
@@ -82,6 +223,11 @@ void NETWORK::FreeState(STATE* state) const
 	MemoryPool.Free(nstate);
 }
 
+size_t NETWORK::GetMemoryUsage() const
+{
+	return MemoryPool.GetMemoryUsage();
+}
+
 bool NETWORK::Step(STATE& state, int action,
 	int& observation, double& reward) const
 {
@@ -89,29 +235,23 @@ bool NETWORK::Step(STATE& state, int action,
 	reward = 0;
 	observation = 2;
 
-	vector<bool> neighbourFailure(NumMachines, false);
-	for (int i = 0; i < NumMachines; i++)
-		for (int j = 0; j < Neighbours[i].size(); ++j)
-			if (!nstate.Machines[Neighbours[i][j]])
-				neighbourFailure[i] = true;
+	// Scratch words are per thread, so that rollouts may run in parallel
+	static thread_local vector<uint64_t> failed, neighbourFailed;
+	failed.resize(NumWords);
+	neighbourFailed.resize(NumWords);
+	for (int w = 0; w < NumWords; ++w)
+		failed[w] = ~nstate.Machines[w] & ValidMask[w];
+	NeighbourFailure(failed, neighbourFailed);
 
-	for (int i = 0; i < NumMachines; i++)
+	// Each word of failures is drawn at once, servers are worth double
+	for (int w = 0; w < NumWords; ++w)
 	{
-		if (!neighbourFailure[i])
-			nstate.Machines[i] = !Bernoulli(FailureProb1);
-		else
-			nstate.Machines[i] = !Bernoulli(FailureProb2);
-	}
-
-	for (int i = 0; i < NumMachines; i++)
-	{
-		if (nstate.Machines[i])
-		{
-			if (Neighbours[i].size() > 2) // server
-				reward += 2;
-			else
-				reward += 1;
-		}
+		uint64_t failures =
+			(neighbourFailed[w] & BernoulliWord(FailureProb2))
+			| (~neighbourFailed[w] & BernoulliWord(FailureProb1));
+		nstate.Machines[w] = ~failures & ValidMask[w];
+		reward += __builtin_popcountll(nstate.Machines[w])
+			+ __builtin_popcountll(nstate.Machines[w] & ServerMask[w]);
 	}
 
 	if (action < NumMachines * 2)
@@ -122,22 +262,134 @@ bool NETWORK::Step(STATE& state, int action,
 		if (reboot)
 		{
 			reward -= 2.5;
-			nstate.Machines[machine] = true;
+			nstate.SetOperational(machine);
 			observation = Bernoulli(ObsProb);
 		}
 		else // ping
 		{
 			reward -= 0.1;
 			if (Bernoulli(ObsProb))
-				observation = nstate.Machines[machine];
+				observation = nstate.Operational(machine);
 			else
-				observation = !nstate.Machines[machine];
+				observation = !nstate.Operational(machine);
 		}
 	}
 
 	return false;
 }
 
+STATE_BATCH* NETWORK::CreateBatch(int size) const
+{
+	return new NETWORK_BATCH(size, NumWords);
+}
+
+void NETWORK::LoadBatch(STATE_BATCH& batch, int lane, const STATE& state,
+	const HISTORY& history) const
+{
+	NETWORK_BATCH& nbatch = safe_cast<NETWORK_BATCH&>(batch);
+	const NETWORK_STATE& nstate = safe_cast<const NETWORK_STATE&>(state);
+	for (int w = 0; w < NumWords; ++w)
+		nbatch.Machines[w * nbatch.Size + lane] = nstate.Machines[w];
+	nbatch.Terminal[lane] = false;
+}
+
+void NETWORK::SelectRandomBatch(STATE_BATCH& batch, const STATUS& status) const
+{
+	// All actions are always legal
+	for (int lane = 0; lane < batch.Size; ++lane)
+		batch.Action[lane] = Random(NumActions);
+}
+
+void NETWORK::StepBatch(STATE_BATCH& batch) const
+{
+	// Same dynamics as Step. Networks that fit in one word are stepped
+	// a whole lane at a time, larger ones go through the scratch vectors
+	NETWORK_BATCH& nbatch = safe_cast<NETWORK_BATCH&>(batch);
+	int size = nbatch.Size;
+	for (int lane = 0; lane < size; ++lane)
+	{
+		nbatch.Reward[lane] = 0;
+		nbatch.Observation[lane] = 2;
+	}
+
+	if (NumWords == 1)
+	{
+		for (int lane = 0; lane < size; ++lane)
+		{
+			if (nbatch.Terminal[lane])
+				continue;
+			uint64_t& machines = nbatch.Machines[lane];
+			uint64_t neighbourFailed = NeighbourFailureWord(~machines & ValidMask[0]);
+			uint64_t failures =
+				(neighbourFailed & BernoulliWord(FailureProb2))
+				| (~neighbourFailed & BernoulliWord(FailureProb1));
+			machines = ~failures & ValidMask[0];
+			nbatch.Reward[lane] = __builtin_popcountll(machines)
+				+ __builtin_popcountll(machines & ServerMask[0]);
+		}
+	}
+	else
+	{
+		vector<uint64_t> failed(NumWords), neighbourFailed(NumWords);
+		for (int lane = 0; lane < size; ++lane)
+		{
+			if (nbatch.Terminal[lane])
+				continue;
+			for (int w = 0; w < NumWords; ++w)
+				failed[w] = ~nbatch.Machines[w * size + lane] & ValidMask[w];
+			NeighbourFailure(failed, neighbourFailed);
+			for (int w = 0; w < NumWords; ++w)
+			{
+				uint64_t failures =
+					(neighbourFailed[w] & BernoulliWord(FailureProb2))
+					| (~neighbourFailed[w] & BernoulliWord(FailureProb1));
+				uint64_t machines = ~failures & ValidMask[w];
+				nbatch.Machines[w * size + lane] = machines;
+				nbatch.Reward[lane] += __builtin_popcountll(machines)
+					+ __builtin_popcountll(machines & ServerMask[w]);
+			}
+		}
+	}
+
+	for (int lane = 0; lane < size; ++lane)
+	{
+		int action = nbatch.Action[lane];
+		if (nbatch.Terminal[lane] || action >= NumMachines * 2)
+			continue;
+
+		int machine = action / 2;
+		uint64_t& word = nbatch.Machines[(machine >> 6) * size + lane];
+		uint64_t bit = uint64_t(1) << (machine & 63);
+		if (action % 2) // reboot
+		{
+			nbatch.Reward[lane] -= 2.5;
+			word |= bit;
+			nbatch.Observation[lane] = Bernoulli(ObsProb);
+		}
+		else // ping
+		{
+			nbatch.Reward[lane] -= 0.1;
+			bool operational = (word & bit) != 0;
+			nbatch.Observation[lane] = Bernoulli(ObsProb) ? operational : !operational;
+		}
+	}
+}
+
+// Networks of one word, stepped a lane at a time, and of several words
+void NETWORK::UnitTest()
+{
+	NETWORK small(10, E_CYCLE);
+	small.UnitTestBatch(4, 100);
+	NETWORK large(100, E_CYCLE);
+	large.UnitTestBatch(4, 100);
+}
+
+const ACTION_SET* NETWORK::LegalActions(const STATE& state,
+	const STATUS& status) const
+{
+	return &AllActions;
+}
+
 void NETWORK::DisplayBeliefs(const BELIEF_STATE& beliefState,
 	std::ostream& ostr) const
 {
@@ -147,7 +399,7 @@ void NETWORK::DisplayState(const STATE& state, std::ostream& ostr) const
 {
 	const NETWORK_STATE& nstate = safe_cast<const NETWORK_STATE&>(state);
 	for (int i = 0; i < NumMachines; i++)
-		ostr << i << ": " << (nstate.Machines[i] ? "operational" : "failed") << endl;
+		ostr << i << ": " << (nstate.Operational(i) ? "operational" : "failed") << endl;
 }
 
 void NETWORK::DisplayObservation(const STATE& state, int observation, std::ostream& ostr) const
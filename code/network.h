@@ -7,7 +7,32 @@ class NETWORK_STATE : public STATE
 {
 public:
 
-	std::vector<bool> Machines;
+	// Operational machines as a bit vector, 64 machines per word
+	std::vector<uint64_t> Machines;
+
+	bool Operational(int machine) const
+	{
+		return (Machines[machine >> 6] >> (machine & 63)) & 1;
+	}
+
+	void SetOperational(int machine)
+	{
+		Machines[machine >> 6] |= uint64_t(1) << (machine & 63);
+	}
+};
+
+// Lanes of network states for StepBatch
+class NETWORK_BATCH : public STATE_BATCH
+{
+public:
+
+	NETWORK_BATCH(int size, int numWords)
+		: STATE_BATCH(size),
+		Machines(size * numWords, 0)
+	{
+	}
+
+	std::vector<uint64_t> Machines; // Indexed by word * Size + lane
 };
 
 class NETWORK : public SIMULATOR
@@ -24,10 +49,20 @@ public:
 
 	virtual STATE* Copy(const STATE& state) const;
 	virtual void Validate(const STATE& state) const;
+	virtual size_t GetMemoryUsage() const;
 	virtual STATE* CreateStartState() const;
 	virtual void FreeState(STATE* state) const;
 	virtual bool Step(STATE& state, int action,
 		int& observation, double& reward) const;
+	virtual const ACTION_SET* LegalActions(const STATE& state,
+		const STATUS& status) const;
+
+	virtual STATE_BATCH* CreateBatch(int size) const;
+	virtual void LoadBatch(STATE_BATCH& batch, int lane, const STATE& state,
+		const HISTORY& history) const;
+	virtual void SelectRandomBatch(STATE_BATCH& batch, const STATUS& status) const;
+	virtual void StepBatch(STATE_BATCH& batch) const;
+	static void UnitTest();
 
 	//    virtual bool Prune(int action, const HISTORY& history) const;
 	//    virtual int SelectRandom(const HISTORY& history) const;
@@ -42,10 +77,22 @@ private:
 
 	void MakeRingNeighbours();
 	void Make3LegsNeighbours();
+	void MakeMasks();
+	void NeighbourFailure(const std::vector<uint64_t>& failed,
+		std::vector<uint64_t>& neighbourFailed) const;
+	uint64_t NeighbourFailureWord(uint64_t failed) const;
 
-	int NumMachines;
+	int NumMachines, NumWords, NetworkType;
 	double FailureProb1, FailureProb2, ObsProb;
-	std::vector<std::vector<int> > Neighbours;
+
+	// Neighbourhoods in compressed sparse row form: the neighbours of
+	// machine i are NeighbourIndex[NeighbourStart[i] .. NeighbourStart[i + 1])
+	std::vector<int> NeighbourStart;
+	std::vector<int> NeighbourIndex;
+
+	std::vector<uint64_t> ValidMask;	// Bits of existing machines
+	std::vector<uint64_t> ServerMask;	// Machines with more than two neighbours
+	ACTION_SET AllActions;
 
 	mutable MEMORY_POOL<NETWORK_STATE> MemoryPool;
 };
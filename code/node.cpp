@@ -14,7 +14,24 @@ void QNODE::Initialise()
 	Children.resize(NumChildren);
 	for (int observation = 0; observation < QNODE::NumChildren; observation++)
 		Children[observation] = 0;
-	AlphaData.AlphaSum.clear();
+	Widened.clear();
+	FreeAlpha();
+}
+
+ALPHA& QNODE::CreateAlpha()
+{
+	if (!AlphaData)
+	{
+		AlphaData.reset(new ALPHA);
+		AlphaData->RewardSum = 0;
+		AlphaData->Count = 0;
+	}
+	return *AlphaData;
+}
+
+void QNODE::FreeAlpha()
+{
+	AlphaData.reset();
 }
 
 void QNODE::DisplayValue(HISTORY& history, int maxDepth, ostream& ostr) const
@@ -77,16 +94,35 @@ void VNODE::Free(VNODE* vnode, const SIMULATOR& simulator)
 	vnode->BeliefState.Free(simulator);
 	VNodePool.Free(vnode);
 	for (int action = 0; action < VNODE::NumChildren; action++)
+	{
+		vnode->Child(action).FreeAlpha();
 		for (int observation = 0; observation < QNODE::NumChildren; observation++)
 			if (vnode->Child(action).Child(observation))
 				Free(vnode->Child(action).Child(observation), simulator);
+	}
 }
 
+// Deleting the chunks destroys every node, which frees the alpha data of
+// the nodes that were still allocated
 void VNODE::FreeAll()
 {
 	VNodePool.DeleteAll();
 }
 
+size_t VNODE::GetHeapMemoryUsage() const
+{
+	size_t bytes = Children.capacity() * sizeof(QNODE);
+	for (int action = 0; action < NumChildren; action++)
+	{
+		const QNODE& qnode = Children[action];
+		bytes += qnode.Children.capacity() * sizeof(VNODE*)
+			+ qnode.Widened.capacity() * sizeof(int);
+		if (qnode.AlphaData)
+			bytes += sizeof(ALPHA) + qnode.AlphaData->AlphaSum.capacity() * sizeof(double);
+	}
+	return bytes;
+}
+
 void VNODE::SetChildren(int count, double value)
 {
 	for (int action = 0; action < NumChildren; action++)
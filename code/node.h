@@ -4,6 +4,7 @@
 #include "beliefstate.h"
 #include "utils.h"
 #include <iostream>
+#include <memory>
 
 class HISTORY;
 class SIMULATOR;
@@ -15,8 +16,9 @@ class VNODE;
 // Only used for explicit POMDPs
 struct ALPHA
 {
-	std::vector<double> AlphaSum;
-	double MaxValue;
+	std::vector<double> AlphaSum;	// Projected alpha values, summed over samples
+	double RewardSum;				// Immediate rewards, summed over samples
+	int Count;
 };
 
 //-----------------------------------------------------------------------------
@@ -77,12 +79,22 @@ public:
 	VALUE<int> Value;
 	VALUE<double> AMAF;
 
+	// Observations whose children were created under progressive widening
+	std::vector<int> Widened;
+
+	QNODE() { }
+
 	void Initialise();
 
 	VNODE*& Child(int c) { return Children[c]; }
 	VNODE* Child(int c) const { return Children[c]; }
-	ALPHA& Alpha() { return AlphaData; }
-	const ALPHA& Alpha() const { return AlphaData; }
+
+	// Alpha data is only allocated when a simulator uses it, and is owned
+	// by the qnode, so it is freed with the node pool's chunks
+	ALPHA* Alpha() { return AlphaData.get(); }
+	const ALPHA* Alpha() const { return AlphaData.get(); }
+	ALPHA& CreateAlpha();
+	void FreeAlpha();
 
 	void DisplayValue(HISTORY& history, int maxDepth, std::ostream& ostr) const;
 	void DisplayPolicy(HISTORY& history, int maxDepth, std::ostream& ostr) const;
@@ -91,7 +103,7 @@ public:
 private:
 
 	std::vector<VNODE*> Children;
-	ALPHA AlphaData;
+	std::unique_ptr<ALPHA> AlphaData;
 	friend class VNODE;
 };
 
@@ -105,6 +117,11 @@ public:
 	static VNODE* Create();
 	static void Free(VNODE* vnode, const SIMULATOR& simulator);
 	static void FreeAll();
+	static int GetNumAllocated() { return VNodePool.GetNumAllocated(); }
+	static size_t GetPoolMemoryUsage() { return VNodePool.GetMemoryUsage(); }
+
+	// Bytes held by the vectors of this node and its qnodes, excluding beliefs
+	size_t GetHeapMemoryUsage() const;
 
 	QNODE& Child(int c) { return Children[c]; }
 	const QNODE& Child(int c) const { return Children[c]; }
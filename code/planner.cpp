@@ -1,81 +1,246 @@
 #include "planner.h"
+#include "profiler.h"
+#include "testsimulator.h"
+#include <thread>
 
-int POSTS::SelectAction()
+// Sample an action from bandit, over the domain's legal action set in place
+// when GenerateActionSpace hands one back, or else over the listed actions
+static int SampleAction(Bandit& bandit, const SIMULATOR& simulator, const STATE& state,
+	const HISTORY& history, std::vector<int>& legal, const SIMULATOR::STATUS& status, const bool preferred)
 {
-	int banditIndex = currentIndex%Params.MaxDepth;
-	reset();
-    Rollout();
+	const ACTION_SET* legalSet = simulator.GenerateActionSpace(state, history, legal, status, preferred);
+	return legalSet ? bandit.sampleFrom(*legalSet) : bandit.sampleFrom(legal);
+}
+
+BanditStackWorker::BanditStackWorker(const std::vector<ThompsonSampling*>& shared, const HISTORY& history, const bool sharded)
+	: history(history), rewards(shared.size(), 0.0), maxNumberOfBandits(0), rollouts(0), sharded(sharded)
+{
+	for (size_t t = 0; t < shared.size(); t++)
+	{
+		if (sharded)
+		{
+			stack.push_back(new ThompsonSampling(*shared[t]));
+			stack[t]->seed(UTILS::RandomWord());
+			shards.push_back(BanditShard());
+		}
+		else
+		{
+			stack.push_back(shared[t]);
+		}
+	}
+}
+
+BanditStackWorker::~BanditStackWorker()
+{
+	if (sharded)
+	{
+		for (size_t t = 0; t < stack.size(); t++)
+		{
+			delete stack[t];
+		}
+	}
+}
+
+void BanditStackWorker::synchronise(const std::vector<ThompsonSampling*>& shared)
+{
+	if (!sharded)
+	{
+		return;
+	}
+	for (size_t t = 0; t < stack.size(); t++)
+	{
+		shared[t]->merge(shards[t]);
+		shards[t].reset();
+		stack[t]->copyStatistics(*shared[t]);
+	}
+}
+
+BanditStackPlanner::BanditStackPlanner(const SIMULATOR& simulator, const PARAMS& params, const unsigned int armCapacity)
+	: MCTS(simulator, params), currentIndex(0), maxNumberOfBandits(0)
+{
+	for (int t = 0; t < Params.MaxDepth; t++)
+	{
+		bandits.push_back(new ThompsonSampling(Simulator.GetNumActions(), armCapacity, params.BanditUpdateDelay, params.BanditBetaPrior));
+	}
+}
+
+BanditStackPlanner::~BanditStackPlanner()
+{
+	for (int t = 0; t < Params.MaxDepth; t++)
+	{
+		delete bandits[t];
+	}
+}
+
+int BanditStackPlanner::SelectAction()
+{
+	if (!Params.ReuseTree)
+	{
+		reset();
+	}
+	maxNumberOfBandits = 0;
+	Rollout();
 	int action = GreedyUCB(Root, false);
+	if (Params.ReuseTree)
+	{
+		Advance();
+	}
 	return action;
 }
 
-void POSTS::Rollout()
+void BanditStackPlanner::GetMemoryUsage(MEMORY_USAGE& usage) const
 {
-	std::vector<double> totals(Simulator.GetNumActions(), 0.0);
-	int historyDepth = History.Size();
-	std::vector<int> legal;
-	assert(BeliefState().GetNumSamples() > 0);
-	for (int i = 0; i < Params.NumSimulations; i++)
+	MCTS::GetMemoryUsage(usage);
+	usage.Bandits = bandits.capacity()*sizeof(ThompsonSampling*);
+	for (int t = 0; t < Params.MaxDepth; t++)
 	{
-                STATE* state = Root->Beliefs().CreateSample(Simulator);
-		Simulator.GenerateActionSpace(*state, GetHistory(), legal, GetStatus(), false);
-		
-		int banditIndex = currentIndex%Params.MaxDepth;
-		int action = bandits[banditIndex]->sampleFrom(legal);
-                Simulator.Validate(*state);
+		usage.Bandits += bandits[t]->memoryUsage();
+	}
+}
 
-		int observation;
-		double immediateReward, delayedReward, totalReward;
-		bool terminal = Simulator.Step(*state, action, observation, immediateReward);
+void BanditStackPlanner::reset()
+{
+	for (int t = 0; t < Params.MaxDepth; t++)
+	{
+		bandits[t]->reset();
+	}
+	currentIndex = 0;
+	maxNumberOfBandits = 0;
+}
 
-		VNODE*& vnode = Root->Child(action).Child(observation);
-		if (!vnode && !terminal)
+// The bandit of depth t + 1 becomes the bandit of depth t, with its evidence
+// scaled by Params.ReuseDecay, and the old root bandit starts again from the
+// prior as the deepest
+void BanditStackPlanner::Advance()
+{
+	if (Params.ReuseDecay < 1)
+	{
+		for (int t = 1; t < Params.MaxDepth; t++)
 		{
-			vnode = ExpandNode(state);
-			AddSample(vnode, *state);
+			bandits[BanditIndex(t)]->decay(Params.ReuseDecay);
 		}
-		History.Add(action, observation);
+	}
+	bandits[currentIndex]->reset();
+	currentIndex = (currentIndex + 1)%Params.MaxDepth;
+}
 
-		delayedReward = Rollout(*state, legal, 1,i);
-		totalReward = immediateReward + Simulator.GetDiscount() * delayedReward;
-		Root->Child(action).Value.Add(totalReward);
-		bandits[banditIndex]->update(totalReward);
-		Simulator.FreeState(state);
-		History.Truncate(historyDepth);
+void BanditStackPlanner::Rollout()
+{
+	assert(BeliefState().GetNumSamples() > 0);
+	std::atomic<int> simulations(0);
+	if (Params.NumThreads <= 1)
+	{
+		BanditStackWorker worker(bandits, GetHistory(), false);
+		Work(worker, simulations, 0);
+		return;
+	}
+
+	// Workers are set up here, as seeding them draws from this thread's generator
+	std::vector<BanditStackWorker*> workers;
+	std::vector<uint64_t> seeds;
+	for (int i = 0; i < Params.NumThreads; i++)
+	{
+		workers.push_back(new BanditStackWorker(bandits, GetHistory(), true));
+		seeds.push_back(UTILS::RandomWord());
+	}
+	std::vector<std::thread> threads;
+	for (int i = 0; i < Params.NumThreads; i++)
+	{
+		threads.push_back(std::thread(&BanditStackPlanner::Work, this,
+			std::ref(*workers[i]), std::ref(simulations), seeds[i]));
+	}
+	for (int i = 0; i < Params.NumThreads; i++)
+	{
+		threads[i].join();
+		delete workers[i];
 	}
 }
 
-double POSTS::Rollout(
-	STATE& state,
-	std::vector<int>& legalActions,
-	const int t,
-	const int i)
+void BanditStackPlanner::Work(BanditStackWorker& worker, std::atomic<int>& simulations, const uint64_t seed)
 {
-	if (t >= Params.MaxDepth)
+	if (seed != 0)
 	{
-		return 0;
+		UTILS::RandomWordSeed(seed);
 	}
-	int numberOfActions = Simulator.GetNumActions();
-	bool terminal = false;
-	int observation;
-	double immediateReward, delayedReward;
-	int banditIndex = (currentIndex + t)%Params.MaxDepth;
-	if (!terminal) {
-		Simulator.GenerateActionSpace(state, GetHistory(), legalActions, GetStatus(), true);
-		int action = bandits[banditIndex]->sampleFrom(legalActions);
-		terminal = Simulator.Step(state, action, observation, immediateReward);
-		History.Add(action, observation);
+	int sinceSynchronised = 0;
+	while (simulations++ < Params.NumSimulations)
+	{
+		Simulate(worker);
+		if (++sinceSynchronised >= Params.SyncInterval)
+		{
+			std::lock_guard<std::mutex> lock(stackMutex);
+			worker.synchronise(bandits);
+			sinceSynchronised = 0;
+		}
+	}
+	std::lock_guard<std::mutex> lock(stackMutex);
+	worker.synchronise(bandits);
+	maxNumberOfBandits = std::max(maxNumberOfBandits, worker.maxNumberOfBandits);
+}
+
+STATE* BanditStackPlanner::CreateRootSample()
+{
+	std::lock_guard<std::mutex> lock(rootMutex);
+	return Root->Beliefs().CreateSample(Simulator);
+}
+
+void BanditStackPlanner::ExpandRoot(const int action, const int observation, const bool terminal, const STATE& state)
+{
+	std::lock_guard<std::mutex> lock(rootMutex);
+	VNODE*& vnode = Root->Child(action).Child(observation);
+	if (!vnode && !terminal)
+	{
+		vnode = ExpandNode(&state);
+		AddSample(vnode, state);
 	}
-	if (terminal)
+}
+
+void BanditStackPlanner::FinishRootSample(const int action, const double totalReward, STATE* state)
+{
+	std::lock_guard<std::mutex> lock(rootMutex);
+	Root->Child(action).Value.Add(totalReward);
+	PROFILED(FREE_STATE, Simulator.FreeState(state));
+}
+
+// A forward pass records the immediate rewards in worker.rewards, then a
+// backward pass turns them into discounted returns and updates the bandit
+// of each depth, so the rollout length is not bounded by the call stack
+void POSTS::Simulate(BanditStackWorker& worker)
+{
+	PROFILE(ROLLOUT);
+	int historyDepth = worker.history.Size();
+	std::vector<double>& rewards = worker.rewards;
+	STATE* state = CreateRootSample();
+	int action = SampleAction(worker.bandit(BanditIndex(0)), Simulator, *state, worker.history, worker.legal, GetStatus(), false);
+	int firstAction = action;
+	Simulator.Validate(*state);
+
+	int observation;
+	double immediateReward;
+	bool terminal = PROFILED(STEP, Simulator.Step(*state, action, observation, immediateReward));
+	ExpandRoot(action, observation, terminal, *state);
+	worker.history.Add(action, observation);
+	rewards[0] = immediateReward;
+	int stepCount = 1;
+	while (!terminal && stepCount < Params.MaxDepth)
 	{
-	        bandits[banditIndex]->update(immediateReward);
-	        return immediateReward;
+		action = SampleAction(worker.bandit(BanditIndex(stepCount)), Simulator, *state, worker.history, worker.legal, GetStatus(), true);
+		terminal = PROFILED(STEP, Simulator.Step(*state, action, observation, immediateReward));
+		worker.history.Add(action, observation);
+		rewards[stepCount] = immediateReward;
+		stepCount++;
 	}
-	double successorReturn = Rollout(state, legalActions, t+1,i);
+
 	double discount = Simulator.GetDiscount();
-	double returnValue = immediateReward + discount*successorReturn;
-	bandits[banditIndex]->update(returnValue);
-	return returnValue;
+	double returnValue = 0;
+	for (int t = stepCount - 1; t >= 0; t--)
+	{
+		returnValue = rewards[t] + discount*returnValue;
+		worker.update(BanditIndex(t), returnValue);
+	}
+	worker.maxNumberOfBandits = std::max(worker.maxNumberOfBandits, stepCount);
+	FinishRootSample(firstAction, returnValue, state);
+	worker.history.Truncate(historyDepth);
 }
 
 void POOLTS::TreeSearch()
@@ -92,29 +257,38 @@ void POOLTS::TreeSearch()
 		double totalReward = Simulate(*state, rootNode, 0);
 		StatTotalReward.Add(totalReward);
 		StatTreeDepth.Add(PeakTreeDepth);
-		Simulator.FreeState(state);
+		PROFILED(FREE_STATE, Simulator.FreeState(state));
 		History.Truncate(historyDepth);
 	}
 }
 
-double POOLTS::Simulate(STATE& state, POOLTSNode* node, int t)
+void POOLTS::decaySubtree(const int node)
+{
+    arena.node(node).bandit.decay(Params.ReuseDecay);
+    for (int action = 0; action < Simulator.GetNumActions(); action++)
+    {
+        int child = arena.getChild(node, action);
+        if (child >= 0)
+        {
+            decaySubtree(child);
+        }
+    }
+}
+
+double POOLTS::Simulate(STATE& state, int node, int t)
 {
     std::vector<int> legal;
-    Simulator.GenerateActionSpace(state, GetHistory(), legal, GetStatus(), false);
-    int action = node->getBandit()->sampleFrom(legal);
+    int action = SampleAction(arena.node(node).bandit, Simulator, state, GetHistory(), legal, GetStatus(), false);
     PeakTreeDepth = TreeDepth;
     if (t >= Params.MaxDepth)
     {
     	return 0;
     }
-    bool isLeaf = node->IsLeaf();
-    if(isLeaf)
-    {
-        node->Expand();
-    }
+    bool isLeaf = arena.node(node).isLeafNode;
+    arena.node(node).isLeafNode = false;
     int observation;
     double immediateReward, delayedReward = 0;
-    bool terminal = Simulator.Step(state, action, observation, immediateReward);
+    bool terminal = PROFILED(STEP, Simulator.Step(state, action, observation, immediateReward));
     if(t == 0)
     {
         VNODE*& vnode = Root->Child(action).Child(observation);
@@ -126,89 +300,184 @@ double POOLTS::Simulate(STATE& state, POOLTSNode* node, int t)
     History.Add(action, observation);
     if(terminal)
     {
-        node->Update(immediateReward);
+        arena.node(node).bandit.update(immediateReward);
         return immediateReward;
     }
     assert(observation >= 0 && observation < Simulator.GetNumObservations());
 
     TreeDepth++;
-    delayedReward = isLeaf? Rollout(state) : Simulate(state, node->getNext(action, pool), t+1);
+    delayedReward = isLeaf? Rollout(state) : Simulate(state, arena.getNext(node, action), t+1);
     TreeDepth--;
 
     double totalReward = immediateReward + Simulator.GetDiscount() * delayedReward;
-    node->Update(totalReward);
+    arena.node(node).bandit.update(totalReward);
     return totalReward;
 }
 
+void SYMBOL::Simulate(BanditStackWorker& worker)
+{
+	PROFILE(ROLLOUT);
+	int historyDepth = worker.history.Size();
+	std::vector<double>& rewards = worker.rewards;
+	STATE* state = CreateRootSample();
+	int action = SampleAction(worker.bandit(BanditIndex(0)), Simulator, *state, worker.history, worker.legal, GetStatus(), false);
+	int firstAction = action;
+	Simulator.Validate(*state);
+
+	int observation;
+	double immediateReward;
+	bool terminal = PROFILED(STEP, Simulator.Step(*state, action, observation, immediateReward));
+	ExpandRoot(action, observation, terminal, *state);
+	worker.history.Add(action, observation);
+    rewards[0] = immediateReward;
+    int stepCount = 1;
+    int horizon = Params.MaxDepth;
+    // Every Params.TruncationProbeInterval-th rollout of a worker probes
+    // the full depth, so that truncated rollouts have returns to go to
+    // bootstrap from
+    bool probe = Params.TruncationProbeInterval > 0 && worker.rollouts++ % Params.TruncationProbeInterval == 0;
+    if (Params.TruncationLookahead >= 0 && !probe)
+    {
+        // Only the bandits up to the first unconverged one learn from this
+        // rollout, so simulate just a few steps past that frontier
+        int frontier = 0;
+        while (frontier < Params.MaxDepth - 1 && worker.bandit(BanditIndex(frontier)).hasConverged(banditConvergenceEpsilon))
+        {
+            frontier++;
+        }
+        horizon = std::min(Params.MaxDepth, frontier + 1 + Params.TruncationLookahead);
+    }
+    for(int t = 1; t < horizon; t++)
+    {
+        if(!terminal)
+        {
+            int action = SampleAction(worker.bandit(BanditIndex(t)), Simulator, *state, worker.history, worker.legal, GetStatus(), true);
+            terminal = PROFILED(STEP, Simulator.Step(*state, action, observation, immediateReward));
+            worker.history.Add(action, observation);
+            rewards[stepCount] = immediateReward;
+            stepCount += 1;
+        }
+    }
+    double returnValue = Bootstrap(stepCount, terminal);
+    for(int t = stepCount - 1; t >= 0; t--)
+    {
+        returnValue = rewards[t] + Simulator.GetDiscount()*returnValue;
+        rewards[t] = returnValue;
+    }
+    AddReturnsToGo(rewards, stepCount);
+    worker.update(BanditIndex(0), rewards[0]);
+    bool predecessorConverged = worker.bandit(BanditIndex(0)).hasConverged(banditConvergenceEpsilon);
+    int numberOfBandits = 1;
+    for(int t = 1; t < stepCount; t++)
+    {
+        if(predecessorConverged)
+        {
+            worker.update(BanditIndex(t), rewards[t]);
+            numberOfBandits += 1;
+            predecessorConverged = worker.bandit(BanditIndex(t)).hasConverged(banditConvergenceEpsilon);
+        }
+    }
+	worker.maxNumberOfBandits = std::max(worker.maxNumberOfBandits, numberOfBandits);
+	FinishRootSample(firstAction, rewards[0], state);
+	worker.history.Truncate(historyDepth);
+}
+
 int SYMBOL::SelectAction()
 {
-	reset();
-	Rollout();
-	return GreedyUCB(Root, false);
+	for (int t = 0; t < Params.MaxDepth; t++)
+	{
+		returnsToGo[t].Clear();
+	}
+	return BanditStackPlanner::SelectAction();
 }
 
-void SYMBOL::Rollout()
+// Estimate the return from depth stepCount on, which truncation left
+// unsimulated. The bandits from there on rarely learn, so the estimate is
+// the mean return to go seen at that depth, which the full-depth probe
+// rollouts keep supplied; without one that got there it is taken as 0
+double SYMBOL::Bootstrap(const int stepCount, const bool terminal)
 {
-	std::vector<double> totals(Simulator.GetNumActions(), 0.0);
-	int historyDepth = History.Size();
-	std::vector<int> legal;
-	assert(BeliefState().GetNumSamples() > 0);
-	for (int i = 0; i < Params.NumSimulations; i++)
+	if (terminal || stepCount >= Params.MaxDepth)
 	{
-		STATE* state = Root->Beliefs().CreateSample(Simulator);
-        STATE* firstState = state;
-		Simulator.GenerateActionSpace(*state, GetHistory(), legal, GetStatus(), false);
-		
-		int action = bandits[0]->sampleFrom(legal);
-        int firstAction = action;
-		Simulator.Validate(*state);
+		return 0;
+	}
+	std::lock_guard<std::mutex> lock(returnsToGoMutex);
+	return returnsToGo[stepCount].GetMean();
+}
+
+void SYMBOL::AddReturnsToGo(const std::vector<double>& returns, const int stepCount)
+{
+	std::lock_guard<std::mutex> lock(returnsToGoMutex);
+	for (int t = 0; t < stepCount; t++)
+	{
+		returnsToGo[t].Add(returns[t]);
+	}
+}
+
+void SYMBOL::UnitTest()
+{
+	UnitTestThreads(8);
+	UnitTestThreads(256);
+	UnitTestBootstrap();
+}
+
+// Every step earns 1, so a rollout truncated right after the root, as all
+// but the first, probing one are until the root bandit converges, must
+// still be credited the return of the whole horizon
+void SYMBOL::UnitTestBootstrap()
+{
+	TEST_SIMULATOR testSimulator(1, 2, 10);
+	PARAMS params;
+	params.MaxDepth = 8;
+	params.NumStartStates = 10;
+	params.NumSimulations = 4;
+	params.TruncationLookahead = 0;
+
+	SYMBOL symbol(testSimulator, params);
+	symbol.Rollout();
+	assert(symbol.getMaxNumberOfBandits() == 1);
+	double expected = 0, discount = 1;
+	for (int t = 0; t < params.MaxDepth; t++)
+	{
+		expected += discount;
+		discount *= testSimulator.GetDiscount();
+	}
+	assert(fabs(symbol.bandits[symbol.BanditIndex(0)]->mean() - expected) < 1e-9);
+}
 
-		int observation;
-		double immediateReward;
-		bool terminal = Simulator.Step(*state, action, observation, immediateReward);
+// With one action the return of each depth is fixed, so the stack only
+// converges once each bandit has recorded enough estimates. Merging the
+// shards of several threads, synchronised only at the end, must leave
+// every depth as converged as the single-threaded run does.
+// Planners share the node pool, so only one is alive at a time
+void SYMBOL::UnitTestThreads(const int numberOfSimulations)
+{
+	TEST_SIMULATOR testSimulator(1, 2, 10);
+	PARAMS params;
+	params.MaxDepth = 4;
+	params.NumStartStates = 10;
+	params.NumSimulations = numberOfSimulations;
+	params.BanditArmCapacity = 8;
+	params.SyncInterval = numberOfSimulations;
+	const double epsilon = params.BanditConvergenceEpsilon;
 
-		VNODE*& vnode = Root->Child(action).Child(observation);
-		if (!vnode && !terminal)
+	std::vector<bool> converged;
+	{
+		SYMBOL single(testSimulator, params);
+		single.Rollout();
+		for (int t = 0; t < params.MaxDepth; t++)
 		{
-			vnode = ExpandNode(state);
-			AddSample(vnode, *state);
+			converged.push_back(single.bandits[t]->hasConverged(epsilon));
+			assert(converged[t] == (numberOfSimulations > params.BanditArmCapacity*params.MaxDepth));
 		}
-		History.Add(action, observation);
-        rewards[0] = immediateReward;
-        int stepCount = 1;
-        for(int t = 1; t < Params.MaxDepth; t++)
-        {
-            if(!terminal)
-            {
-                Simulator.GenerateActionSpace(*state, GetHistory(), legal, GetStatus(), true);
-                int action = bandits[t]->sampleFrom(legal);
-                terminal = Simulator.Step(*state, action, observation, immediateReward);
-                History.Add(action, observation);
-                rewards[stepCount] = immediateReward;
-                stepCount += 1;
-            }
-        }
-        double returnValue = 0;
-        for(int t = stepCount - 1; t >= 0; t--)
-        {
-            returnValue = rewards[t] + Simulator.GetDiscount()*returnValue;
-            rewards[t] = returnValue;
-        }
-		Root->Child(firstAction).Value.Add(rewards[0]);
-        bandits[0]->update(rewards[0]);
-        bool predecessorConverged = bandits[0]->hasConverged(banditConvergenceEpsilon);
-        int numberOfBandits = 1;
-        for(int t = 1; t < stepCount; t++)
-        {
-            if(predecessorConverged)
-            {
-                bandits[t]->update(rewards[t]);
-                numberOfBandits += 1;
-                predecessorConverged = bandits[t]->hasConverged(banditConvergenceEpsilon);
-            }
-        }
-		maxNumberOfBandits = std::max(maxNumberOfBandits, numberOfBandits);
-		Simulator.FreeState(firstState);
-		History.Truncate(historyDepth);
 	}
+
+	params.NumThreads = 4;
+	SYMBOL sharded(testSimulator, params);
+	sharded.Rollout();
+	for (int t = 0; t < params.MaxDepth; t++)
+	{
+		assert(sharded.bandits[t]->hasConverged(epsilon) == converged[t]);
+	}
+	assert(sharded.bandits[0]->count() == numberOfSimulations);
 }
@@ -2,210 +2,292 @@
 #include "mcts.h"
 #include "bandit.h"
 #include <fstream>
-#include <list>
 #include <algorithm>
-class POSTS : public MCTS
+#include <atomic>
+#include <mutex>
+// One rollout thread's view of a stack of bandits, one bandit per depth.
+// Alone, it samples from and updates the shared stack directly. Sharded,
+// it samples from a private snapshot of the stack, which also takes its
+// own rewards, and gathers those rewards in shards until they are merged
+// into the shared stack by synchronise
+class BanditStackWorker
 {
 public:
-	POSTS(const SIMULATOR& simulator, const PARAMS& params) : MCTS(simulator, params), currentIndex(0)
+	BanditStackWorker(const std::vector<ThompsonSampling*>& shared, const HISTORY& history, const bool sharded);
+	~BanditStackWorker();
+	ThompsonSampling& bandit(const int index)
 	{
-		for (int t = 0; t < Params.MaxDepth; t++)
-		{
-			bandits.push_back(new ThompsonSampling(Simulator.GetNumActions(), 0, 1, params.BanditBetaPrior));
-		}
-	}
-	virtual ~POSTS()
-	{
-		for (int t = 0; t < Params.MaxDepth; t++)
-		{
-			delete bandits[t];
-		}
+		return *stack[index];
 	}
-	void reset()
+	void update(const int index, const double reward)
 	{
-		for (int t = 0; t < Params.MaxDepth; t++)
+		stack[index]->update(reward);
+		if (sharded)
 		{
-			bandits[t]->reset();
+			shards[index].update(stack[index]->currentPlayIndex(), reward);
 		}
 	}
+	// Merge the shards into the shared stack and refresh the snapshot
+	void synchronise(const std::vector<ThompsonSampling*>& shared);
+
+	HISTORY history;
+	std::vector<int> legal;
+	std::vector<double> rewards;
+	int maxNumberOfBandits;
+	int rollouts;
+private:
+	bool sharded;
+	std::vector<ThompsonSampling*> stack;
+	std::vector<BanditShard> shards;
+};
+
+// Open-loop planner over a stack of Thompson sampling bandits. With
+// Params.NumThreads above one the rollouts run on that many threads, each
+// with a sharded BanditStackWorker synchronised every Params.SyncInterval
+// of its rollouts. The root node and the simulator's memory pool are shared,
+// so they are only touched through CreateRootSample, ExpandRoot and
+// FinishRootSample.
+// The bandit of depth t is bandits[BanditIndex(t)]. With Params.ReuseTree
+// the stack is rotated after each decision instead of being reset, so the
+// next decision starts from the posteriors of depth 1 onwards
+class BanditStackPlanner : public MCTS
+{
+public:
+	BanditStackPlanner(const SIMULATOR& simulator, const PARAMS& params, const unsigned int armCapacity);
+	virtual ~BanditStackPlanner();
 	virtual int SelectAction();
-	double Rollout(STATE& state, std::vector<int>& legalActions, const int t, const int i);
+	virtual void GetMemoryUsage(MEMORY_USAGE& usage) const;
+	void reset();
+	// Run Params.NumSimulations rollouts from the root belief
 	void Rollout();
-private:
-	int currentIndex;
+	// Most bandits updated by one rollout in the last decision
+	const int getMaxNumberOfBandits() const
+	{
+		return maxNumberOfBandits;
+	}
+protected:
+	virtual void Simulate(BanditStackWorker& worker) = 0;
+	int BanditIndex(const int t) const
+	{
+		return (currentIndex + t)%Params.MaxDepth;
+	}
+	void Advance();
+	STATE* CreateRootSample();
+	void ExpandRoot(const int action, const int observation, const bool terminal, const STATE& state);
+	void FinishRootSample(const int action, const double totalReward, STATE* state);
+
 	std::vector<ThompsonSampling*> bandits;
+	int currentIndex;
+	int maxNumberOfBandits;
+private:
+	void Work(BanditStackWorker& worker, std::atomic<int>& simulations, const uint64_t seed);
+
+	std::mutex rootMutex;
+	std::mutex stackMutex;
 };
 
+class POSTS : public BanditStackPlanner
+{
+public:
+	POSTS(const SIMULATOR& simulator, const PARAMS& params) : BanditStackPlanner(simulator, params, 0)
+	{
+	}
+	virtual ~POSTS()
+	{
+	}
+protected:
+	virtual void Simulate(BanditStackWorker& worker);
+};
+
+// Open-loop tree node: a bandit over the actions taken at this depth
+// after the actions on the path from the root
 class POOLTSNode
 {
 public:
-    POOLTSNode(const SIMULATOR& simulator, const MCTS::PARAMS& params) : Simulator(simulator), Params(params), numberOfActions(simulator.GetNumActions())
+    POOLTSNode(const SIMULATOR& simulator, const MCTS::PARAMS& params)
+        : bandit(simulator.GetNumActions(), 0, params.BanditUpdateDelay, params.BanditBetaPrior), generation(0), isLeafNode(true)
     {
-	this->bandit = new ThompsonSampling(numberOfActions, 0, 1, params.BanditBetaPrior);
     }
-    ~POOLTSNode()
+    ThompsonSampling bandit;
+    unsigned int generation;
+    bool isLeafNode;
+};
+
+// Arena of POOLTS nodes, addressed by index. The children of node i are
+// children[i*numberOfActions .. (i+1)*numberOfActions), -1 if absent.
+// A node is live while its generation matches the arena's, so the whole
+// tree is recycled in O(1) by advancing the generation; nodes of older
+// generations are reclaimed by a lazy sweep as new nodes are allocated.
+// A search allocates at most one node per simulation, and a reused subtree
+// is at most one search's worth, so room for that many is reserved up
+// front; beyond it, growing the arena moves the nodes' bandits rather than
+// copying their statistics
+class POOLTSArena
+{
+public:
+    POOLTSArena(const SIMULATOR& simulator, const MCTS::PARAMS& params)
+        : Simulator(simulator), Params(params), numberOfActions(simulator.GetNumActions()), generation(1), sweep(0)
     {
-	delete bandit;
-        int children_size = children.size();
-        for(int index = 0; index < children_size; index++)
-        {
-            if(this->children[index] != NULL)
-	    {
-                delete this->children[index];
-	    }
-        }
-        this->children.clear();
+        int reserved = (params.ReuseTree ? 2 : 1)*(params.NumSimulations + 1);
+        nodes.reserve(reserved);
+        children.reserve(reserved*numberOfActions);
     }
-    int SelectAction()
+    int allocate()
     {
-        return this->bandit->play();
-    }
-    void Expand() {
-	if(this->children.empty())
-	{
-   	    for(int index = 0; index < numberOfActions; index++)
-	    {
-	        this->children.push_back(NULL);
-	    }
-	}
-        this->isLeafNode = false;
+        while (sweep < (int)nodes.size() && nodes[sweep].generation == generation)
+        {
+            sweep++;
+        }
+        int index = sweep++;
+        if (index == (int)nodes.size())
+        {
+            nodes.push_back(POOLTSNode(Simulator, Params));
+            children.resize(nodes.size()*numberOfActions);
+        }
+        POOLTSNode& node = nodes[index];
+        node.bandit.reset();
+        node.generation = generation;
+        node.isLeafNode = true;
+        std::fill(&children[index*numberOfActions], &children[index*numberOfActions] + numberOfActions, -1);
+        return index;
     }
-    Bandit* getBandit()
+    void recycle()
     {
-        return bandit;
+        generation++;
+        sweep = 0;
     }
-    void Update(const double reward)
+    // Recycle every node except the subtree below root, in O(subtree size)
+    void recycleExcept(const int root)
     {
-        bandit->update(reward);
+        recycle();
+        stack.clear();
+        stack.push_back(root);
+        while (!stack.empty())
+        {
+            int index = stack.back();
+            stack.pop_back();
+            nodes[index].generation = generation;
+            for (int action = 0; action < numberOfActions; action++)
+            {
+                if (children[index*numberOfActions + action] >= 0)
+                {
+                    stack.push_back(children[index*numberOfActions + action]);
+                }
+            }
+        }
     }
-    POOLTSNode* getNext(const int action, std::list<POOLTSNode*>& pool)
+    int getChild(const int index, const int action) const
     {
-        POOLTSNode* child = children[action];
-	if(child == NULL)
-	{
-	    if(!pool.empty())
-	    {
-	    	child = pool.front();
-		pool.pop_front();
-	    }
-	    else
-	    {
-	    	child = new POOLTSNode(Simulator, Params);
-	    }
-	    children[action] = child;
-	}
-	return child;
+        return children[index*numberOfActions + action];
     }
-    void resetNext(const int action)
+    POOLTSNode& node(const int index)
     {
-    	this->children[action] = NULL;
+        return nodes[index];
     }
-    const bool IsLeaf()
+    int getNext(const int index, const int action)
     {
-        return this->isLeafNode;
+        int child = children[index*numberOfActions + action];
+        if (child < 0)
+        {
+            child = allocate();
+            children[index*numberOfActions + action] = child;
+        }
+        return child;
     }
-    void reset()
+    int size() const
     {
-    	this->isLeafNode = true;
-    	this->bandit->reset();
+        return nodes.size();
     }
-    void saveToPool(std::list<POOLTSNode*>& pool)
+    size_t memoryUsage() const
     {
-	int numberOfChildren = this->children.size();
-        for(int index = 0; index < numberOfChildren; index++)
-	{
-             if(this->children[index] != NULL)
-	     {
-                 this->children[index]->saveToPool(pool);
-	     }
-	}
-	this->children.clear();
-	this->reset();
-	pool.push_back(this);
+        size_t bytes = nodes.capacity()*sizeof(POOLTSNode)
+            + (children.capacity() + stack.capacity())*sizeof(int);
+        for (size_t index = 0; index < nodes.size(); index++)
+        {
+            bytes += nodes[index].bandit.memoryUsage() - sizeof(ThompsonSampling);
+        }
+        return bytes;
     }
 private:
-    Bandit* bandit;
-    std::vector<POOLTSNode*> children;
-    bool isLeafNode = true;
-    const int numberOfActions;
     const SIMULATOR& Simulator;
     const MCTS::PARAMS& Params;
+    const int numberOfActions;
+    unsigned int generation;
+    int sweep;
+    std::vector<POOLTSNode> nodes;
+    std::vector<int> children;
+    std::vector<int> stack;
 };
 
 class POOLTS : public MCTS
 {
 public:
-    POOLTS(const SIMULATOR& simulator, const PARAMS& params) : MCTS(simulator, params)
+    POOLTS(const SIMULATOR& simulator, const PARAMS& params) : MCTS(simulator, params), arena(simulator, Params)
     {
-    	this->rootNode = new POOLTSNode(simulator, params);
+    	this->rootNode = arena.allocate();
     }
     virtual ~POOLTS()
     {
-        delete rootNode;
-	int pool_size = pool.size();
-	for(int index = 0; index < pool_size; index++)
-	{
-	    POOLTSNode* next = pool.front();
-	    delete next;
-	    pool.pop_front();
-	}
-	pool.clear();
     }
     virtual int SelectAction()
     {
 	TreeSearch();
-	int action = rootNode->SelectAction();
-	rootNode->saveToPool(pool);
-	rootNode = pool.front();
-	pool.pop_front();
-	rootNode->reset();
+	int action = arena.node(rootNode).bandit.play();
+	int child = arena.getChild(rootNode, action);
+	if (Params.ReuseTree && child >= 0)
+	{
+	    // The child for the executed action already holds the statistics
+	    // of the next time step, so it becomes the root
+	    arena.recycleExcept(child);
+	    rootNode = child;
+	    if (Params.ReuseDecay < 1)
+	    {
+	        decaySubtree(rootNode);
+	    }
+	}
+	else
+	{
+	    arena.recycle();
+	    rootNode = arena.allocate();
+	}
         return action;
     }
     virtual void TreeSearch();
-    virtual double Simulate(STATE& state, POOLTSNode* node, int t);
+    virtual double Simulate(STATE& state, int node, int t);
+    virtual void GetMemoryUsage(MEMORY_USAGE& usage) const
+    {
+        MCTS::GetMemoryUsage(usage);
+        usage.Bandits = arena.memoryUsage();
+    }
 private:
-    POOLTSNode* rootNode;
-    std::list<POOLTSNode*> pool;
+    void decaySubtree(const int node);
+
+    POOLTSArena arena;
+    int rootNode;
 };
 
-class SYMBOL : public MCTS
+class SYMBOL : public BanditStackPlanner
 {
 public:
-	SYMBOL(const SIMULATOR& simulator, const PARAMS& params) : MCTS(simulator, params), currentIndex(0), banditConvergenceEpsilon(params.BanditConvergenceEpsilon), maxNumberOfBandits(0)
+	SYMBOL(const SIMULATOR& simulator, const PARAMS& params) : BanditStackPlanner(simulator, params, params.BanditArmCapacity), banditConvergenceEpsilon(params.BanditConvergenceEpsilon), returnsToGo(params.MaxDepth)
 	{
-		for (int t = 0; t < Params.MaxDepth; t++)
-		{
-			bandits.push_back(new ThompsonSampling(Simulator.GetNumActions(), Params.BanditArmCapacity, 1, params.BanditBetaPrior));
-            rewards.push_back(0.0);
-		}
 	}
 	virtual ~SYMBOL()
 	{
-		for (int t = 0; t < Params.MaxDepth; t++)
-		{
-			delete bandits[t];
-		}
-	}
-	void reset()
-	{
-		for (int t = 0; t < Params.MaxDepth; t++)
-		{
-			bandits[t]->reset();
-            rewards[t] = 0.0;
-		}
-        maxNumberOfBandits = 0;
 	}
 	virtual int SelectAction();
-	double Rollout(STATE& state, std::vector<int>& legalActions, const int t, const int i);
-    const int getMaxNumberOfBandits()
-    {
-        return maxNumberOfBandits;
-    }
-	void Rollout();
+	static void UnitTest();
+protected:
+	virtual void Simulate(BanditStackWorker& worker);
 private:
-	int currentIndex;
+	double Bootstrap(const int stepCount, const bool terminal);
+	void AddReturnsToGo(const std::vector<double>& returns, const int stepCount);
+	static void UnitTestThreads(const int numberOfSimulations);
+	static void UnitTestBootstrap();
+
     double banditConvergenceEpsilon;
-    int maxNumberOfBandits;
-	std::vector<ThompsonSampling*> bandits;
-    std::vector<double> rewards;
+	// Return from each depth on, over every rollout of this decision that
+	// reached it, whether or not its bandits learnt from it
+	std::vector<STATISTIC> returnsToGo;
+	std::mutex returnsToGoMutex;
 };
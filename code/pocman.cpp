@@ -56,6 +56,7 @@ MICRO_POCMAN::MICRO_POCMAN()
 	GhostRange = 3;
 	PocmanHome = COORD(3, 0);
 	GhostHome = COORD(3, 4);
+	InitLegal();
 }
 
 MINI_POCMAN::MINI_POCMAN()
@@ -83,6 +84,7 @@ MINI_POCMAN::MINI_POCMAN()
 	PocmanHome = COORD(4, 2);
 	GhostHome = COORD(4, 4);
 	PassageY = 5;
+	InitLegal();
 }
 
 FULL_POCMAN::FULL_POCMAN()
@@ -120,6 +122,21 @@ FULL_POCMAN::FULL_POCMAN()
 	PocmanHome = COORD(8, 6);
 	GhostHome = COORD(8, 10);
 	PassageY = 10;
+	InitLegal();
+}
+
+void POCMAN::InitLegal()
+{
+	// Legal moves only depend on the position, so precompute them per cell
+	LegalMoves.resize(Maze.GetXSize() * Maze.GetYSize());
+	for (size_t index = 0; index < LegalMoves.size(); ++index)
+	{
+		LegalMoves[index].Resize(NumActions);
+		COORD pos = Maze.Coord(index);
+		for (int a = 0; a < 4; ++a)
+			if (NextPos(pos, a).Valid())
+				LegalMoves[index].Add(a);
+	}
 }
 
 STATE* POCMAN::Copy(const STATE& state) const
@@ -158,6 +175,11 @@ void POCMAN::FreeState(STATE* state) const
 	MemoryPool.Free(pocstate);
 }
 
+size_t POCMAN::GetMemoryUsage() const
+{
+	return MemoryPool.GetMemoryUsage();
+}
+
 COORD POCMAN::NextPos(const COORD& from, int dir) const
 {
 	COORD nextPos;
@@ -449,15 +471,15 @@ bool POCMAN::SmellFood(const POCMAN_STATE& pocstate) const
 void POCMAN::GenerateLegal(const STATE& state, const HISTORY& history,
 	vector<int>& legal, const STATUS& status) const
 {
-	const POCMAN_STATE& pocstate = safe_cast<const POCMAN_STATE&>(state);
-
 	// Don't move into walls 
-	for (int a = 0; a < 4; ++a)
-	{
-		COORD newpos = NextPos(pocstate.PocmanPos, a);
-		if (newpos.Valid())
-			legal.push_back(a);
-	}
+	LegalActions(state, status)->AppendTo(legal);
+}
+
+const ACTION_SET* POCMAN::LegalActions(const STATE& state,
+	const STATUS& status) const
+{
+	const POCMAN_STATE& pocstate = safe_cast<const POCMAN_STATE&>(state);
+	return &LegalMoves[Maze.Index(pocstate.PocmanPos)];
 }
 
 void POCMAN::GeneratePreferred(const STATE& state, const HISTORY& history,
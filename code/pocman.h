@@ -24,6 +24,7 @@ public:
 
 	virtual STATE* Copy(const STATE& state) const;
 	virtual void Validate(const STATE& state) const;
+	virtual size_t GetMemoryUsage() const;
 	virtual STATE* CreateStartState() const;
 	virtual void FreeState(STATE* state) const;
 	virtual bool Step(STATE& state, int action,
@@ -35,6 +36,8 @@ public:
 		std::vector<int>& legal, const STATUS& status) const;
 	void GeneratePreferred(const STATE& state, const HISTORY& history,
 		std::vector<int>& legal, const STATUS& status) const;
+	virtual const ACTION_SET* LegalActions(const STATE& state,
+		const STATUS& status) const;
 
 	virtual void DisplayBeliefs(const BELIEF_STATE& beliefState,
 		std::ostream& ostr) const;
@@ -45,6 +48,7 @@ public:
 protected:
 
 	POCMAN(int xsize, int ysize);
+	void InitLegal();
 
 	enum {
 		E_PASSABLE,
@@ -74,6 +78,8 @@ private:
 	bool Passable(const COORD& pos) const { return UTILS::CheckFlag(Maze(pos), E_PASSABLE); }
 	int MakeObservations(const POCMAN_STATE& pocstate) const;
 
+	std::vector<ACTION_SET> LegalMoves; // Legal moves from each cell
+
 	mutable MEMORY_POOL<POCMAN_STATE> MemoryPool;
 };
 
@@ -0,0 +1,52 @@
+#include "profiler.h"
+#include <iomanip>
+
+using namespace std;
+
+atomic<uint64_t> PROFILER::Time[PROFILER::NUM_PHASES];
+atomic<uint64_t> PROFILER::Calls[PROFILER::NUM_PHASES];
+
+const char* PROFILER::Names[PROFILER::NUM_PHASES] =
+{
+	"Step",
+	"CreateSample",
+	"Copy",
+	"FreeState",
+	"GreedyUCB",
+	"ExpandNode",
+	"Prior",
+	"Rollout",
+	"AddTransforms",
+	"LocalMove",
+	"Bandit sample",
+	"Bandit update",
+	"Free node"
+};
+
+void PROFILER::Clear()
+{
+	for (int phase = 0; phase < NUM_PHASES; phase++)
+	{
+		Time[phase] = 0;
+		Calls[phase] = 0;
+	}
+}
+
+void PROFILER::Display(ostream& ostr)
+{
+	ostr << setw(16) << left << "Phase" << right
+		<< setw(12) << "Calls" << setw(14) << "Total ms" << setw(12) << "ns/call" << endl;
+	for (int phase = 0; phase < NUM_PHASES; phase++)
+	{
+		uint64_t calls = Calls[phase];
+		if (calls == 0)
+			continue;
+		uint64_t time = Time[phase];
+		ostr << setw(16) << left << Names[phase] << right
+			<< setw(12) << calls
+			<< setw(14) << fixed << setprecision(3) << time * 1e-6
+			<< setw(12) << setprecision(1) << (double) time / calls << endl;
+	}
+	ostr.unsetf(ios::floatfield);
+	ostr << setprecision(6);
+}
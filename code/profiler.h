@@ -0,0 +1,92 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <stdint.h>
+
+//----------------------------------------------------------------------------
+// Scoped steady_clock timers around the hot paths of the planners.
+// They are only compiled in with -DUSE_PROFILER, otherwise PROFILE and
+// PROFILED add nothing. Times are inclusive: a rollout includes its steps.
+// Totals are shared by all threads, so parallel rollouts add up
+
+class PROFILER
+{
+public:
+
+	enum PHASE
+	{
+		STEP,
+		CREATE_SAMPLE,
+		COPY,
+		FREE_STATE,
+		GREEDY_UCB,
+		EXPAND_NODE,
+		PRIOR,
+		ROLLOUT,
+		ADD_TRANSFORMS,
+		LOCAL_MOVE,
+		BANDIT_SAMPLE,
+		BANDIT_UPDATE,
+		FREE_NODE,
+		NUM_PHASES
+	};
+
+	// Times the lifetime of the scope it is declared in
+	class SCOPE
+	{
+	public:
+
+		SCOPE(PHASE phase)
+			: Phase(phase), Start(std::chrono::steady_clock::now())
+		{
+		}
+
+		~SCOPE()
+		{
+			Add(Phase, std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - Start).count());
+		}
+
+	private:
+
+		PHASE Phase;
+		std::chrono::steady_clock::time_point Start;
+	};
+
+	static void Add(PHASE phase, uint64_t nanoseconds)
+	{
+		Time[phase].fetch_add(nanoseconds, std::memory_order_relaxed);
+		Calls[phase].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	static void Clear();
+
+	// Calls, total time and time per call of each phase that was entered
+	static void Display(std::ostream& ostr);
+
+private:
+
+	static std::atomic<uint64_t> Time[NUM_PHASES];
+	static std::atomic<uint64_t> Calls[NUM_PHASES];
+	static const char* Names[NUM_PHASES];
+};
+
+#define PROFILER_CONCAT2(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT2(a, b)
+
+#ifdef USE_PROFILER
+// Time the rest of the enclosing scope
+#define PROFILE(phase) PROFILER::SCOPE PROFILER_CONCAT(profilerScope, __LINE__)(PROFILER::phase)
+// Time one call, keeping its value
+#define PROFILED(phase, call) (PROFILER::SCOPE(PROFILER::phase), call)
+#else
+#define PROFILE(phase)
+#define PROFILED(phase, call) (call)
+#endif
+
+//----------------------------------------------------------------------------
+
+#endif // PROFILER_H
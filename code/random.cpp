@@ -1,4 +1,6 @@
 #include "random.h"
+#include <assert.h>
+#include <math.h>
 
 int randomInt(const int range) {
 	return randomInt(0, range);
@@ -11,3 +13,194 @@ int randomInt(const int min, const int range) {
 double randomDouble() {
 	return ((double)rand()) / RAND_MAX;
 }
+
+// Marsaglia and Tsang's 128 layer ziggurat for the normal distribution
+namespace
+{
+	const double zigguratR = 3.442619855899;
+
+	struct Ziggurat
+	{
+		uint32_t kn[128];
+		double wn[128];
+		double fn[128];
+
+		Ziggurat()
+		{
+			const double m1 = 2147483648.0;
+			const double vn = 9.91256303526217e-3;
+			double dn = zigguratR, tn = dn;
+			double q = vn / exp(-0.5 * dn * dn);
+
+			kn[0] = (uint32_t)((dn / q) * m1);
+			kn[1] = 0;
+			wn[0] = q / m1;
+			wn[127] = dn / m1;
+			fn[0] = 1.0;
+			fn[127] = exp(-0.5 * dn * dn);
+			for (int i = 126; i >= 1; i--)
+			{
+				dn = sqrt(-2.0 * log(vn / dn + exp(-0.5 * dn * dn)));
+				kn[i + 1] = (uint32_t)((dn / tn) * m1);
+				tn = dn;
+				fn[i] = exp(-0.5 * dn * dn);
+				wn[i] = dn / m1;
+			}
+		}
+	};
+
+	const Ziggurat ziggurat;
+}
+
+FastRandom::FastRandom(const uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15ULL)
+{
+}
+
+double FastRandom::normal()
+{
+	uint64_t bits = next();
+	int64_t hz = (int32_t)(bits >> 32);
+	int iz = bits & 127;
+	if ((uint64_t)(hz < 0 ? -hz : hz) < ziggurat.kn[iz])
+	{
+		return hz * ziggurat.wn[iz];
+	}
+	return normalTail(hz, iz);
+}
+
+double FastRandom::normalTail(int64_t hz, int iz)
+{
+	for (;;)
+	{
+		double x = hz * ziggurat.wn[iz];
+		if (iz == 0)
+		{
+			double y;
+			do
+			{
+				x = -log(uniform()) / zigguratR;
+				y = -log(uniform());
+			} while (y + y < x * x);
+			return hz > 0 ? zigguratR + x : -zigguratR - x;
+		}
+		if (ziggurat.fn[iz] + uniform() * (ziggurat.fn[iz - 1] - ziggurat.fn[iz]) < exp(-0.5 * x * x))
+		{
+			return x;
+		}
+		uint64_t bits = next();
+		hz = (int32_t)(bits >> 32);
+		iz = bits & 127;
+		if ((uint64_t)(hz < 0 ? -hz : hz) < ziggurat.kn[iz])
+		{
+			return hz * ziggurat.wn[iz];
+		}
+	}
+}
+
+double FastRandom::gamma(const double d, const double c)
+{
+	for (;;)
+	{
+		double x, v;
+		do
+		{
+			x = normal();
+			v = 1.0 + c * x;
+		} while (v <= 0);
+		v = v * v * v;
+		double u = uniform();
+		double x2 = x * x;
+		if (u < 1.0 - 0.0331 * x2 * x2)
+		{
+			return d * v;
+		}
+		if (log(u) < 0.5 * x2 + d * (1.0 - v + log(v)))
+		{
+			return d * v;
+		}
+	}
+}
+
+// Mean, variance and mass beyond two, and mass and mean beyond the
+// ziggurat's base strip, which between them take every path of normal()
+// and normalTail()
+static void unitTestNormal()
+{
+	FastRandom generator(1);
+	const int n = 1000000;
+	double sum = 0, sumSquares = 0, sumBase = 0;
+	int beyondTwo = 0, beyondBase = 0;
+	for (int i = 0; i < n; i++)
+	{
+		double x = generator.normal();
+		sum += x;
+		sumSquares += x * x;
+		beyondTwo += fabs(x) > 2;
+		if (fabs(x) > zigguratR)
+		{
+			beyondBase++;
+			sumBase += fabs(x);
+		}
+	}
+	double mean = sum / n;
+	double variance = sumSquares / n - mean * mean;
+	assert(fabs(mean) < 5 * sqrt(1.0 / n));
+	assert(fabs(variance - 1) < 5 * sqrt(2.0 / n));
+
+	// Two-sided tail masses, within five standard deviations of their counts
+	double expectedTwo = erfc(2 / sqrt(2.0)) * n;
+	double expectedBase = erfc(zigguratR / sqrt(2.0)) * n;
+	assert(fabs(beyondTwo - expectedTwo) < 5 * sqrt(expectedTwo));
+	assert(fabs(beyondBase - expectedBase) < 5 * sqrt(expectedBase));
+
+	// Beyond R the normal is truncated, with mean lambda = phi(R) / Q(R)
+	// and variance 1 + R lambda - lambda^2
+	double lambda = exp(-0.5 * zigguratR * zigguratR) / sqrt(2 * M_PI)
+		/ (0.5 * erfc(zigguratR / sqrt(2.0)));
+	double tailVariance = 1 + zigguratR * lambda - lambda * lambda;
+	assert(fabs(sumBase / beyondBase - lambda) < 5 * sqrt(tailVariance / beyondBase));
+}
+
+// Gamma(alpha, 1) has mean and variance alpha. For an integer shape the
+// tail is P(X > t) = exp(-t) sum_{i < alpha} t^i / i!, checked three
+// standard deviations out
+static void unitTestGamma(const int alpha)
+{
+	FastRandom generator(alpha);
+	const double d = alpha - 1.0 / 3.0;
+	const double c = 1.0 / sqrt(9.0 * d);
+	const double t = alpha + 3 * sqrt((double)alpha);
+	const int n = 1000000;
+	double sum = 0, sumSquares = 0;
+	int beyond = 0;
+	for (int i = 0; i < n; i++)
+	{
+		double x = generator.gamma(d, c);
+		assert(x > 0);
+		sum += x;
+		sumSquares += x * x;
+		beyond += x > t;
+	}
+	double mean = sum / n;
+	double variance = sumSquares / n - mean * mean;
+	assert(fabs(mean - alpha) < 5 * sqrt(alpha / (double)n));
+	// The variance of the sample variance is alpha^2 (2 + 6 / alpha) / n
+	assert(fabs(variance - alpha) < 5 * alpha * sqrt((2 + 6.0 / alpha) / n));
+
+	double tail = 0, term = 1;
+	for (int i = 0; i < alpha; i++)
+	{
+		tail += term;
+		term *= t / (i + 1);
+	}
+	double expected = exp(-t) * tail * n;
+	assert(fabs(beyond - expected) < 5 * sqrt(expected));
+}
+
+void FastRandom::unitTest()
+{
+	unitTestNormal();
+	unitTestGamma(1);
+	unitTestGamma(3);
+	unitTestGamma(10);
+}
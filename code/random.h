@@ -1,9 +1,46 @@
 #pragma once
 #include <stdlib.h>
 #include <time.h>
+#include <stdint.h>
 
 int randomInt(const int range);
 
 int randomInt(const int min, const int range);
 
 double randomDouble();
+
+// Fast generator for posterior sampling: xorshift64* bits,
+// ziggurat normal variates and Marsaglia-Tsang gamma variates
+class FastRandom
+{
+public:
+	FastRandom(const uint64_t seed);
+
+	uint64_t next()
+	{
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 0x2545F4914F6CDD1DULL;
+	}
+
+	// Uniform in (0, 1)
+	double uniform()
+	{
+		return ((next() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+	}
+
+	// Standard normal
+	double normal();
+
+	// Gamma with shape alpha >= 1 and unit scale, given the Marsaglia-Tsang
+	// constants d = alpha - 1/3 and c = 1 / sqrt(9d)
+	double gamma(const double d, const double c);
+
+	static void unitTest();
+
+private:
+	double normalTail(int64_t hz, int iz);
+
+	uint64_t state;
+};
@@ -0,0 +1,121 @@
+#include "resultswriter.h"
+#include <math.h>
+#include <stdio.h>
+
+using namespace std;
+
+RESULTS_WRITER::RESULTS_WRITER(const string& fileName)
+	: Buffer(BufferSize)
+{
+	if (fileName.empty())
+		return;
+	// The buffer must be in place before the file is opened
+	File.rdbuf()->pubsetbuf(&Buffer[0], Buffer.size());
+	File.open(fileName.c_str());
+}
+
+RESULTS_WRITER::~RESULTS_WRITER()
+{
+	if (File.is_open())
+		File.flush();
+}
+
+void RESULTS_WRITER::Begin(const string& record)
+{
+	Record = "{";
+	Add("record", record);
+}
+
+void RESULTS_WRITER::Add(const string& name, int value)
+{
+	AddName(name);
+	Record += to_string(value);
+}
+
+void RESULTS_WRITER::Add(const string& name, long long value)
+{
+	AddName(name);
+	Record += to_string(value);
+}
+
+void RESULTS_WRITER::Add(const string& name, size_t value)
+{
+	AddName(name);
+	Record += to_string(value);
+}
+
+void RESULTS_WRITER::Add(const string& name, double value)
+{
+	AddName(name);
+	if (isfinite(value))
+	{
+		char number[32];
+		snprintf(number, sizeof(number), "%.10g", value);
+		Record += number;
+	}
+	else
+	{
+		// JSON has no infinities or NaNs
+		Record += "null";
+	}
+}
+
+void RESULTS_WRITER::Add(const string& name, bool value)
+{
+	AddName(name);
+	Record += value ? "true" : "false";
+}
+
+void RESULTS_WRITER::Add(const string& name, const string& value)
+{
+	AddName(name);
+	AddString(value);
+}
+
+void RESULTS_WRITER::Add(const string& name, const char* value)
+{
+	Add(name, string(value));
+}
+
+void RESULTS_WRITER::End(bool flush)
+{
+	Record += "}\n";
+	if (!File.is_open())
+		return;
+	File.write(Record.data(), Record.size());
+	if (flush)
+		File.flush();
+}
+
+void RESULTS_WRITER::AddName(const string& name)
+{
+	if (Record.size() > 1)
+		Record += ", ";
+	AddString(name);
+	Record += ": ";
+}
+
+void RESULTS_WRITER::AddString(const string& value)
+{
+	Record += '"';
+	for (size_t i = 0; i < value.size(); i++)
+	{
+		char c = value[i];
+		if (c == '"' || c == '\\')
+		{
+			Record += '\\';
+			Record += c;
+		}
+		else if ((unsigned char) c < 0x20)
+		{
+			char escape[8];
+			snprintf(escape, sizeof(escape), "\\u%04x", c);
+			Record += escape;
+		}
+		else
+		{
+			Record += c;
+		}
+	}
+	Record += '"';
+}
@@ -0,0 +1,46 @@
+#ifndef RESULTS_WRITER_H
+#define RESULTS_WRITER_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Results as JSON Lines: one object per line, each with a "record" field
+// naming its kind, followed by its fields in the order they were added.
+// A record is built in memory and reaches the file whole, through a large
+// stream buffer that is flushed only at the end of records that ask for it,
+// so readers never see part of a record. With no file name nothing is written
+
+class RESULTS_WRITER
+{
+public:
+
+	RESULTS_WRITER(const std::string& fileName);
+	~RESULTS_WRITER();
+
+	void Begin(const std::string& record);
+	void Add(const std::string& name, int value);
+	void Add(const std::string& name, long long value);
+	void Add(const std::string& name, size_t value);
+	void Add(const std::string& name, double value);
+	void Add(const std::string& name, bool value);
+	void Add(const std::string& name, const std::string& value);
+	void Add(const std::string& name, const char* value);
+	void End(bool flush = false);
+
+private:
+
+	void AddName(const std::string& name);
+	void AddString(const std::string& value);
+
+	static const int BufferSize = 1 << 16;
+
+	std::vector<char> Buffer;
+	std::ofstream File;
+	std::string Record;
+};
+
+//----------------------------------------------------------------------------
+
+#endif // RESULTS_WRITER_H
@@ -22,6 +22,7 @@ ROCKSAMPLE::ROCKSAMPLE(int size, int rocks)
 		Init_11_11();
 	else
 		InitGeneral();
+	InitEfficiency();
 }
 
 void ROCKSAMPLE::InitGeneral()
@@ -99,6 +100,23 @@ void ROCKSAMPLE::Init_11_11()
 	}
 }
 
+void ROCKSAMPLE::InitEfficiency()
+{
+	// Accuracy of checking each rock from each position
+	Efficiency.resize(Size * Size * NumRocks);
+	for (int y = 0; y < Size; ++y)
+	{
+		for (int x = 0; x < Size; ++x)
+		{
+			for (int rock = 0; rock < NumRocks; ++rock)
+			{
+				double distance = COORD::EuclideanDistance(COORD(x, y), RockPos[rock]);
+				Efficiency[(y * Size + x) * NumRocks + rock] =
+					(1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
+			}
+		}
+	}
+}
 
 STATE* ROCKSAMPLE::Copy(const STATE& state) const
 {
@@ -132,6 +150,10 @@ STATE* ROCKSAMPLE::CreateStartState() const
 		rockstate->Rocks.push_back(entry);
 	}
 	rockstate->Target = SelectTarget(*rockstate);
+	rockstate->Legal.Resize(NumActions);
+	for (int rock = 0; rock < NumRocks; ++rock)
+		rockstate->Legal.Add(rock + 1 + E_SAMPLE);
+	UpdateLegalMoves(*rockstate);
 	return rockstate;
 }
 
@@ -141,6 +163,11 @@ void ROCKSAMPLE::FreeState(STATE* state) const
 	MemoryPool.Free(rockstate);
 }
 
+size_t ROCKSAMPLE::GetMemoryUsage() const
+{
+	return MemoryPool.GetMemoryUsage();
+}
+
 bool ROCKSAMPLE::Step(STATE& state, int action,
 	int& observation, double& reward) const
 {
@@ -193,6 +220,7 @@ bool ROCKSAMPLE::Step(STATE& state, int action,
 		if (rock >= 0 && !rockstate.Rocks[rock].Collected)
 		{
 			rockstate.Rocks[rock].Collected = true;
+			rockstate.Legal.Remove(rock + 1 + E_SAMPLE);
 			if (rockstate.Rocks[rock].Valuable)
 				reward = +10;
 			else
@@ -211,8 +239,8 @@ bool ROCKSAMPLE::Step(STATE& state, int action,
 		observation = GetObservation(rockstate, rock);
 		rockstate.Rocks[rock].Measured++;
 
-		double distance = COORD::EuclideanDistance(rockstate.AgentPos, RockPos[rock]);
-		double efficiency = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
+		double efficiency = Efficiency[(rockstate.AgentPos.Y * Size
+			+ rockstate.AgentPos.X) * NumRocks + rock];
 
 		if (observation == E_GOOD)
 		{
@@ -235,10 +263,160 @@ bool ROCKSAMPLE::Step(STATE& state, int action,
 	if (rockstate.Target < 0 || rockstate.AgentPos == RockPos[rockstate.Target])
 		rockstate.Target = SelectTarget(rockstate);
 
+	if (action <= E_SAMPLE)
+		UpdateLegalMoves(rockstate);
+
 	assert(reward != -100);
 	return false;
 }
 
+STATE_BATCH* ROCKSAMPLE::CreateBatch(int size) const
+{
+	// Smart rollouts need the per-rock statistics of full states,
+	// and each lane keeps its legal actions in a single word
+	if (Knowledge.RolloutLevel >= KNOWLEDGE::SMART || NumActions > 64)
+		return SIMULATOR::CreateBatch(size);
+	return new ROCKSAMPLE_BATCH(size);
+}
+
+void ROCKSAMPLE::LoadBatch(STATE_BATCH& batch, int lane, const STATE& state,
+	const HISTORY& history) const
+{
+	ROCKSAMPLE_BATCH* rbatch = dynamic_cast<ROCKSAMPLE_BATCH*>(&batch);
+	if (!rbatch)
+	{
+		SIMULATOR::LoadBatch(batch, lane, state, history);
+		return;
+	}
+
+	const ROCKSAMPLE_STATE& rockstate = safe_cast<const ROCKSAMPLE_STATE&>(state);
+	rbatch->X[lane] = rockstate.AgentPos.X;
+	rbatch->Y[lane] = rockstate.AgentPos.Y;
+	rbatch->Valuable[lane] = 0;
+	rbatch->Collected[lane] = 0;
+	for (int rock = 0; rock < NumRocks; ++rock)
+	{
+		rbatch->Valuable[lane] |= uint64_t(rockstate.Rocks[rock].Valuable) << rock;
+		rbatch->Collected[lane] |= uint64_t(rockstate.Rocks[rock].Collected) << rock;
+	}
+	rbatch->Terminal[lane] = false;
+}
+
+void ROCKSAMPLE::SelectRandomBatch(STATE_BATCH& batch, const STATUS& status) const
+{
+	ROCKSAMPLE_BATCH* rbatch = dynamic_cast<ROCKSAMPLE_BATCH*>(&batch);
+	if (!rbatch)
+	{
+		SIMULATOR::SelectRandomBatch(batch, status);
+		return;
+	}
+
+	if (Knowledge.RolloutLevel == KNOWLEDGE::PURE)
+	{
+		for (int lane = 0; lane < rbatch->Size; ++lane)
+			rbatch->Action[lane] = Random(NumActions);
+		return;
+	}
+
+	// Same legal actions as UpdateLegalMoves, as one word per lane
+	uint64_t allChecks = ((uint64_t(1) << NumRocks) - 1) << (E_SAMPLE + 1);
+	for (int lane = 0; lane < rbatch->Size; ++lane)
+	{
+		int x = rbatch->X[lane], y = rbatch->Y[lane];
+		int rock = Grid(x, y);
+		uint64_t collected = rbatch->Collected[lane];
+		uint64_t legal = (allChecks & ~(collected << (E_SAMPLE + 1)))
+			| (uint64_t(y + 1 < Size) << COORD::E_NORTH)
+			| (uint64_t(1) << COORD::E_EAST)
+			| (uint64_t(y > 0) << COORD::E_SOUTH)
+			| (uint64_t(x > 0) << COORD::E_WEST)
+			| (uint64_t(rock >= 0 && !((collected >> rock) & 1)) << E_SAMPLE);
+
+		for (int r = Random(__builtin_popcountll(legal)); r > 0; --r)
+			legal &= legal - 1;
+		rbatch->Action[lane] = __builtin_ctzll(legal);
+	}
+}
+
+void ROCKSAMPLE::StepBatch(STATE_BATCH& batch) const
+{
+	ROCKSAMPLE_BATCH* rbatch = dynamic_cast<ROCKSAMPLE_BATCH*>(&batch);
+	if (!rbatch)
+	{
+		SIMULATOR::StepBatch(batch);
+		return;
+	}
+
+	// Same dynamics as Step, without the smart knowledge
+	for (int lane = 0; lane < rbatch->Size; ++lane)
+	{
+		int action = rbatch->Action[lane];
+		int& x = rbatch->X[lane];
+		int& y = rbatch->Y[lane];
+		double& reward = rbatch->Reward[lane];
+		int& observation = rbatch->Observation[lane];
+		reward = 0;
+		observation = E_NONE;
+		if (rbatch->Terminal[lane])
+			continue;
+
+		if (action < E_SAMPLE)
+		{
+			int dx = COORD::Compass[action].X, dy = COORD::Compass[action].Y;
+			if (x + dx >= Size)
+			{
+				reward = +10;
+				rbatch->Terminal[lane] = true;
+			}
+			else if (x + dx < 0 || y + dy < 0 || y + dy >= Size)
+			{
+				reward = -100;
+			}
+			else
+			{
+				x += dx;
+				y += dy;
+			}
+		}
+		else if (action == E_SAMPLE)
+		{
+			int rock = Grid(x, y);
+			if (rock >= 0 && !((rbatch->Collected[lane] >> rock) & 1))
+			{
+				rbatch->Collected[lane] |= uint64_t(1) << rock;
+				reward = ((rbatch->Valuable[lane] >> rock) & 1) ? +10 : -10;
+			}
+			else
+			{
+				reward = -100;
+			}
+		}
+		else
+		{
+			int rock = action - E_SAMPLE - 1;
+			bool valuable = (rbatch->Valuable[lane] >> rock) & 1;
+			bool correct = Bernoulli(Efficiency[(y * Size + x) * NumRocks + rock]);
+			observation = valuable == correct ? E_GOOD : E_BAD;
+		}
+
+		assert(reward != -100);
+	}
+}
+
+// The native batch with pure and legal rollouts, and the default batch
+// that smart rollouts fall back to
+void ROCKSAMPLE::UnitTest()
+{
+	ROCKSAMPLE rocksample(7, 8);
+	KNOWLEDGE knowledge;
+	for (int level = KNOWLEDGE::PURE; level < KNOWLEDGE::NUM_LEVELS; ++level)
+	{
+		knowledge.RolloutLevel = level;
+		rocksample.SetKnowledge(knowledge);
+		rocksample.UnitTestBatch(4, 100);
+	}
+}
+
 bool ROCKSAMPLE::LocalMove(STATE& state, const HISTORY& history,
 	int stepObs, const STATUS& status) const
 {
@@ -268,28 +446,30 @@ bool ROCKSAMPLE::LocalMove(STATE& state, const HISTORY& history,
 void ROCKSAMPLE::GenerateLegal(const STATE& state, const HISTORY& history,
 	vector<int>& legal, const STATUS& status) const
 {
-
 	const ROCKSAMPLE_STATE& rockstate =
 		safe_cast<const ROCKSAMPLE_STATE&>(state);
+	rockstate.Legal.AppendTo(legal);
+}
 
-	if (rockstate.AgentPos.Y + 1 < Size)
-		legal.push_back(COORD::E_NORTH);
-
-	legal.push_back(COORD::E_EAST);
-
-	if (rockstate.AgentPos.Y - 1 >= 0)
-		legal.push_back(COORD::E_SOUTH);
+const ACTION_SET* ROCKSAMPLE::LegalActions(const STATE& state,
+	const STATUS& status) const
+{
+	const ROCKSAMPLE_STATE& rockstate =
+		safe_cast<const ROCKSAMPLE_STATE&>(state);
+	return &rockstate.Legal;
+}
 
-	if (rockstate.AgentPos.X - 1 >= 0)
-		legal.push_back(COORD::E_WEST);
+void ROCKSAMPLE::UpdateLegalMoves(ROCKSAMPLE_STATE& rockstate) const
+{
+	// Check actions are only removed when a rock is collected,
+	// moves and sampling depend on the agent position
+	rockstate.Legal.Set(COORD::E_NORTH, rockstate.AgentPos.Y + 1 < Size);
+	rockstate.Legal.Add(COORD::E_EAST);
+	rockstate.Legal.Set(COORD::E_SOUTH, rockstate.AgentPos.Y - 1 >= 0);
+	rockstate.Legal.Set(COORD::E_WEST, rockstate.AgentPos.X - 1 >= 0);
 
 	int rock = Grid(rockstate.AgentPos);
-	if (rock >= 0 && !rockstate.Rocks[rock].Collected)
-		legal.push_back(E_SAMPLE);
-
-	for (rock = 0; rock < NumRocks; ++rock)
-		if (!rockstate.Rocks[rock].Collected)
-			legal.push_back(rock + 1 + E_SAMPLE);
+	rockstate.Legal.Set(E_SAMPLE, rock >= 0 && !rockstate.Rocks[rock].Collected);
 }
 
 void ROCKSAMPLE::GeneratePreferred(const STATE& state, const HISTORY& history,
@@ -309,20 +489,12 @@ void ROCKSAMPLE::GeneratePreferred(const STATE& state, const HISTORY& history,
 
 	// Sample rocks with more +ve than -ve observations
 	int rock = Grid(rockstate.AgentPos);
+	// Count holds the net number of good minus bad checks for each rock,
+	// maintained incrementally by Step and LocalMove, so there is no need
+	// to rescan the history
 	if (rock >= 0 && !rockstate.Rocks[rock].Collected)
 	{
-		int total = 0;
-		for (int t = 0; t < history.Size(); ++t)
-		{
-			if (history[t].Action == rock + 1 + E_SAMPLE)
-			{
-				if (history[t].Observation == E_GOOD)
-					total++;
-				if (history[t].Observation == E_BAD)
-					total--;
-			}
-		}
-		if (total > 0)
+		if (rockstate.Rocks[rock].Count > 0)
 		{
 			actions.push_back(E_SAMPLE);
 			return;
@@ -342,19 +514,7 @@ void ROCKSAMPLE::GeneratePreferred(const STATE& state, const HISTORY& history,
 		const ROCKSAMPLE_STATE::ENTRY& entry = rockstate.Rocks[rock];
 		if (!entry.Collected)
 		{
-			int total = 0;
-			for (int t = 0; t < history.Size(); ++t)
-			{
-				if (history[t].Action == rock + 1 + E_SAMPLE)
-				{
-					if (history[t].Observation == E_GOOD)
-						total++;
-					if (history[t].Observation == E_BAD)
-						total--;
-				}
-			}
-
-			if (total >= 0)
+			if (entry.Count >= 0)
 			{
 				all_bad = false;
 
@@ -412,8 +572,8 @@ void ROCKSAMPLE::GeneratePreferred(const STATE& state, const HISTORY& history,
 
 int ROCKSAMPLE::GetObservation(const ROCKSAMPLE_STATE& rockstate, int rock) const
 {
-	double distance = COORD::EuclideanDistance(rockstate.AgentPos, RockPos[rock]);
-	double efficiency = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
+	double efficiency = Efficiency[(rockstate.AgentPos.Y * Size
+		+ rockstate.AgentPos.X) * NumRocks + rock];
 
 	if (Bernoulli(efficiency))
 		return rockstate.Rocks[rock].Valuable ? E_GOOD : E_BAD;
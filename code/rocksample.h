@@ -14,7 +14,7 @@ public:
 	{
 		bool Valuable;
 		bool Collected;
-		int Count;    				// Smart knowledge
+		int Count;    				// Smart knowledge (good minus bad checks)
 		int Measured; 				// Smart knowledge
 		double LikelihoodValuable;	// Smart knowledge
 		double LikelihoodWorthless;	// Smart knowledge
@@ -22,6 +22,25 @@ public:
 	};
 	std::vector<ENTRY> Rocks;
 	int Target; // Smart knowledge
+	ACTION_SET Legal; // Maintained by Step
+};
+
+// Lanes of rocksample states for StepBatch, without smart knowledge
+class ROCKSAMPLE_BATCH : public STATE_BATCH
+{
+public:
+
+	ROCKSAMPLE_BATCH(int size)
+		: STATE_BATCH(size),
+		X(size, 0),
+		Y(size, 0),
+		Valuable(size, 0),
+		Collected(size, 0)
+	{
+	}
+
+	std::vector<int> X, Y;
+	std::vector<uint64_t> Valuable, Collected; // One bit per rock
 };
 
 class ROCKSAMPLE : public SIMULATOR
@@ -32,15 +51,25 @@ public:
 
 	virtual STATE* Copy(const STATE& state) const;
 	virtual void Validate(const STATE& state) const;
+	virtual size_t GetMemoryUsage() const;
 	virtual STATE* CreateStartState() const;
 	virtual void FreeState(STATE* state) const;
 	virtual bool Step(STATE& state, int action,
 		int& observation, double& reward) const;
 
+	virtual STATE_BATCH* CreateBatch(int size) const;
+	virtual void LoadBatch(STATE_BATCH& batch, int lane, const STATE& state,
+		const HISTORY& history) const;
+	virtual void SelectRandomBatch(STATE_BATCH& batch, const STATUS& status) const;
+	virtual void StepBatch(STATE_BATCH& batch) const;
+	static void UnitTest();
+
 	void GenerateLegal(const STATE& state, const HISTORY& history,
 		std::vector<int>& legal, const STATUS& status) const;
 	void GeneratePreferred(const STATE& state, const HISTORY& history,
 		std::vector<int>& legal, const STATUS& status) const;
+	virtual const ACTION_SET* LegalActions(const STATE& state,
+		const STATUS& status) const;
 	virtual bool LocalMove(STATE& state, const HISTORY& history,
 		int stepObservation, const STATUS& status) const;
 
@@ -67,14 +96,17 @@ protected:
 	void InitGeneral();
 	void Init_7_8();
 	void Init_11_11();
+	void InitEfficiency();
 	int GetObservation(const ROCKSAMPLE_STATE& rockstate, int rock) const;
 	int SelectTarget(const ROCKSAMPLE_STATE& rockstate) const;
+	void UpdateLegalMoves(ROCKSAMPLE_STATE& rockstate) const;
 
 	GRID<int> Grid;
 	std::vector<COORD> RockPos;
 	int Size, NumRocks;
 	COORD StartPos;
 	double HalfEfficiencyDistance;
+	std::vector<double> Efficiency; // Indexed by (y * Size + x) * NumRocks + rock
 	double SmartMoveProb;
 	int UncertaintyCount;
 
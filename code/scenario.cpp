@@ -0,0 +1,237 @@
+#include "experiment.h"
+#include "pocman.h"
+#include "rocksample.h"
+#include "utils.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// End-to-end throughput scenarios: canonical workloads run through
+// EXPERIMENT::Throughput with a fixed seed and a fixed number of decisions.
+//
+// Usage: scenario run [name filter]
+//        scenario record <baseline file> [name filter]
+//        scenario check <baseline file> [tolerance] [name filter]
+//
+// record writes the measurements as the new baseline. check compares them
+// with the baseline and exits with 1 if any scenario has fewer simulations
+// or decisions per second by more than tolerance (a fraction, 0.3 by
+// default), or uses that much more memory. Planner bytes are the sum of the
+// largest tree, particle, state and bandit sizes. Peak RSS is process-wide,
+// and the latency percentiles are histogram buckets an eighth of a power of
+// two wide, so those are shown but not checked.
+//
+// Wall-clock throughput varies with the load of the machine, by a quarter
+// on shared machines, so each scenario is run Repeats times and the best of
+// each measurement is kept. A baseline only holds for the machine that
+// recorded it: record one locally before checking a change against it
+
+struct SCENARIO
+{
+	const char* Name;
+	SIMULATOR* (*Create)();
+	bool UsePOSTS;
+	int Doubles;
+	int MaxDepth;
+	int Decisions;
+};
+
+static const SCENARIO Scenarios[] =
+{
+	{ "rocksample_11_11_posts_2^12", []() -> SIMULATOR* { return new ROCKSAMPLE(11, 11); }, true, 12, 30, 32 },
+	{ "pocman_mcts_2^10", []() -> SIMULATOR* { return new FULL_POCMAN(); }, false, 10, 100, 32 }
+};
+
+static const int Seed = 1;
+static const int Repeats = 3;
+
+struct MEASUREMENT
+{
+	double SimulationsPerSecond;
+	double DecisionsPerSecond;
+	double P50;		// Decision latency percentiles in milliseconds
+	double P99;
+	double PlannerBytes;
+	double PeakResidentBytes;
+};
+
+static const char* Header =
+	"Scenario\tSimulations/s\tDecisions/s\tp50 ms\tp99 ms\tPlanner bytes\tPeak RSS bytes";
+
+static MEASUREMENT Measure(const SCENARIO& scenario)
+{
+	UTILS::RandomSeed(Seed);
+	unique_ptr<SIMULATOR> real(scenario.Create());
+	unique_ptr<SIMULATOR> simulator(scenario.Create());
+	SIMULATOR::KNOWLEDGE knowledge;
+	knowledge.RolloutLevel = SIMULATOR::KNOWLEDGE::LEGAL;
+	simulator->SetKnowledge(knowledge);
+
+	EXPERIMENT::PARAMS expParams;
+	expParams.NumSteps = scenario.Decisions;
+	expParams.usePOSTS = scenario.UsePOSTS;
+	// Planner bytes are checked, so sample them after every decision
+	expParams.MemoryInterval = 1;
+	MCTS::PARAMS searchParams;
+	searchParams.MaxDepth = scenario.MaxDepth;
+	searchParams.BanditBetaPrior = 1;
+
+	// Throughput writes nothing to the output file
+	EXPERIMENT experiment(*real, *simulator, "", expParams, searchParams);
+	experiment.Throughput(scenario.Doubles);
+	const RESULTS& results = experiment.GetResults();
+
+	const HISTOGRAM& latency = results.DecisionLatency;
+
+	MEASUREMENT measurement;
+	measurement.DecisionsPerSecond = latency.GetCount() / latency.GetTotal();
+	measurement.SimulationsPerSecond = measurement.DecisionsPerSecond * (1 << scenario.Doubles);
+	measurement.P50 = latency.GetPercentile(0.5) * 1000;
+	measurement.P99 = latency.GetPercentile(0.99) * 1000;
+	measurement.PlannerBytes = results.TreeBytes.GetMax() + results.ParticleBytes.GetMax()
+		+ results.StateBytes.GetMax() + results.BanditBytes.GetMax();
+	measurement.PeakResidentBytes = results.PeakResidentBytes.GetMax();
+	return measurement;
+}
+
+// Keep the best of each measurement of two runs of the same scenario
+static void KeepBest(MEASUREMENT& best, const MEASUREMENT& measurement)
+{
+	best.SimulationsPerSecond = max(best.SimulationsPerSecond, measurement.SimulationsPerSecond);
+	best.DecisionsPerSecond = max(best.DecisionsPerSecond, measurement.DecisionsPerSecond);
+	best.P50 = min(best.P50, measurement.P50);
+	best.P99 = min(best.P99, measurement.P99);
+	best.PlannerBytes = min(best.PlannerBytes, measurement.PlannerBytes);
+	best.PeakResidentBytes = max(best.PeakResidentBytes, measurement.PeakResidentBytes);
+}
+
+static void Write(ostream& ostr, const string& name, const MEASUREMENT& measurement)
+{
+	ostr << name << "\t"
+		<< fixed << setprecision(1)
+		<< measurement.SimulationsPerSecond << "\t"
+		<< measurement.DecisionsPerSecond << "\t"
+		<< setprecision(3)
+		<< measurement.P50 << "\t"
+		<< measurement.P99 << "\t"
+		<< (size_t) measurement.PlannerBytes << "\t"
+		<< (size_t) measurement.PeakResidentBytes << endl;
+}
+
+static bool Read(const string& fileName, map<string, MEASUREMENT>& baseline)
+{
+	ifstream input(fileName.c_str());
+	if (!input)
+		return false;
+	string line;
+	getline(input, line);
+	while (getline(input, line))
+	{
+		istringstream fields(line);
+		string name;
+		MEASUREMENT measurement;
+		if (fields >> name >> measurement.SimulationsPerSecond >> measurement.DecisionsPerSecond
+			>> measurement.P50 >> measurement.P99 >> measurement.PlannerBytes
+			>> measurement.PeakResidentBytes)
+			baseline[name] = measurement;
+	}
+	return true;
+}
+
+// Names of the measurements that regressed beyond tolerance
+static string Regressions(const MEASUREMENT& measurement, const MEASUREMENT& baseline, double tolerance)
+{
+	string regressions;
+	if (measurement.SimulationsPerSecond < baseline.SimulationsPerSecond * (1 - tolerance))
+		regressions += " simulations/s";
+	if (measurement.DecisionsPerSecond < baseline.DecisionsPerSecond * (1 - tolerance))
+		regressions += " decisions/s";
+	if (measurement.PlannerBytes > baseline.PlannerBytes * (1 + tolerance))
+		regressions += " planner bytes";
+	return regressions;
+}
+
+int main(int argc, char* argv[])
+{
+	string mode = argc > 1 ? argv[1] : "run";
+	string baselineFile, filter;
+	double tolerance = 0.3;
+	if (mode == "run")
+	{
+		filter = argc > 2 ? argv[2] : "";
+	}
+	else if ((mode == "record" || mode == "check") && argc > 2)
+	{
+		baselineFile = argv[2];
+		if (mode == "check" && argc > 3)
+			tolerance = stod(argv[3]);
+		filter = argc > (mode == "check" ? 4 : 3) ? argv[mode == "check" ? 4 : 3] : "";
+	}
+	else
+	{
+		cout << "Usage: scenario run [filter]" << endl
+			<< "       scenario record <baseline file> [filter]" << endl
+			<< "       scenario check <baseline file> [tolerance] [filter]" << endl;
+		return 2;
+	}
+
+	map<string, MEASUREMENT> baseline;
+	if (mode == "check" && !Read(baselineFile, baseline))
+	{
+		cout << "Cannot read baseline " << baselineFile << endl;
+		return 2;
+	}
+
+	vector<string> names;
+	vector<MEASUREMENT> measurements;
+	for (size_t i = 0; i < sizeof(Scenarios) / sizeof(Scenarios[0]); i++)
+	{
+		if (string(Scenarios[i].Name).find(filter) == string::npos)
+			continue;
+		cout << "Scenario " << Scenarios[i].Name << endl;
+		names.push_back(Scenarios[i].Name);
+		MEASUREMENT measurement = Measure(Scenarios[i]);
+		for (int repeat = 1; repeat < Repeats; repeat++)
+			KeepBest(measurement, Measure(Scenarios[i]));
+		measurements.push_back(measurement);
+	}
+
+	cout << Header << endl;
+	for (size_t i = 0; i < names.size(); i++)
+		Write(cout, names[i], measurements[i]);
+
+	if (mode == "record")
+	{
+		ofstream output(baselineFile.c_str());
+		output << Header << endl;
+		for (size_t i = 0; i < names.size(); i++)
+			Write(output, names[i], measurements[i]);
+		return 0;
+	}
+
+	bool regressed = false;
+	if (mode == "check")
+	{
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			map<string, MEASUREMENT>::const_iterator entry = baseline.find(names[i]);
+			if (entry == baseline.end())
+			{
+				cout << names[i] << ": no baseline" << endl;
+				continue;
+			}
+			string regressions = Regressions(measurements[i], entry->second, tolerance);
+			cout << names[i] << ": " << (regressions.empty() ? "ok" : "regressed:" + regressions) << endl;
+			if (!regressions.empty())
+				regressed = true;
+		}
+	}
+	return regressed ? 1 : 0;
+}
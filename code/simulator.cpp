@@ -3,6 +3,56 @@
 using namespace std;
 using namespace UTILS;
 
+STATE_BATCH::STATE_BATCH(int size)
+	: Size(size),
+	Action(size, 0),
+	Observation(size, 0),
+	Reward(size, 0),
+	Terminal(size, true)
+{
+}
+
+STATE_BATCH::~STATE_BATCH()
+{
+}
+
+bool STATE_BATCH::AllTerminal() const
+{
+	for (int lane = 0; lane < Size; ++lane)
+		if (!Terminal[lane])
+			return false;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Default batch for simulators without a native one
+
+class STATE_LANES : public STATE_BATCH
+{
+public:
+
+	STATE_LANES(const SIMULATOR& simulator, int size)
+		: STATE_BATCH(size),
+		Simulator(simulator),
+		States(size, 0),
+		Histories(size)
+	{
+	}
+
+	~STATE_LANES()
+	{
+		for (int lane = 0; lane < Size; ++lane)
+			if (States[lane])
+				Simulator.FreeState(States[lane]);
+	}
+
+	const SIMULATOR& Simulator;
+	std::vector<STATE*> States;
+	std::vector<HISTORY> Histories;
+};
+
+//-----------------------------------------------------------------------------
+
 SIMULATOR::KNOWLEDGE::KNOWLEDGE()
 	: TreeLevel(LEGAL),
 	RolloutLevel(LEGAL),
@@ -37,6 +87,101 @@ SIMULATOR::~SIMULATOR()
 {
 }
 
+STATE_BATCH* SIMULATOR::CreateBatch(int size) const
+{
+	return new STATE_LANES(*this, size);
+}
+
+void SIMULATOR::LoadBatch(STATE_BATCH& batch, int lane, const STATE& state,
+	const HISTORY& history) const
+{
+	STATE_LANES& lanes = safe_cast<STATE_LANES&>(batch);
+	if (lanes.States[lane])
+		FreeState(lanes.States[lane]);
+	lanes.States[lane] = Copy(state);
+	lanes.Histories[lane] = history;
+	lanes.Terminal[lane] = false;
+}
+
+void SIMULATOR::SelectRandomBatch(STATE_BATCH& batch, const STATUS& status) const
+{
+	STATE_LANES& lanes = safe_cast<STATE_LANES&>(batch);
+	for (int lane = 0; lane < lanes.Size; ++lane)
+		if (!lanes.Terminal[lane])
+			lanes.Action[lane] = SelectRandom(*lanes.States[lane],
+				lanes.Histories[lane], status);
+}
+
+void SIMULATOR::StepBatch(STATE_BATCH& batch) const
+{
+	STATE_LANES& lanes = safe_cast<STATE_LANES&>(batch);
+	for (int lane = 0; lane < lanes.Size; ++lane)
+	{
+		lanes.Reward[lane] = 0;
+		if (lanes.Terminal[lane])
+			continue;
+		lanes.Terminal[lane] = Step(*lanes.States[lane], lanes.Action[lane],
+			lanes.Observation[lane], lanes.Reward[lane]);
+		lanes.Histories[lane].Add(lanes.Action[lane], lanes.Observation[lane]);
+	}
+}
+
+void SIMULATOR::UnitTestBatch(int size, int numSteps) const
+{
+	STATUS status;
+	status.Phase = STATUS::ROLLOUT;
+	vector<int> legal;
+	for (int live = 0; live < size; ++live)
+	{
+		STATE_BATCH* batch = CreateBatch(size);
+		STATE* state = CreateStartState();
+		for (int lane = 0; lane < size; ++lane)
+		{
+			STATE* other = CreateStartState();
+			LoadBatch(*batch, lane, lane == live ? *state : *other, HISTORY());
+			FreeState(other);
+		}
+		for (int lane = 0; lane < size; ++lane)
+			batch->Terminal[lane] = lane != live;
+
+		HISTORY history;
+		bool terminal = false;
+		for (int t = 0; t < numSteps && !terminal; ++t)
+		{
+			legal.clear();
+			GenerateLegal(*state, history, legal, status);
+			SelectRandomBatch(*batch, status);
+			if (Knowledge.RolloutLevel >= KNOWLEDGE::LEGAL)
+				assert(Contains(legal, batch->Action[live]));
+			int action = legal[Random(legal.size())];
+			int seed = Random(LargeInteger);
+
+			int observation;
+			double reward;
+			RandomSeed(seed);
+			terminal = Step(*state, action, observation, reward);
+			history.Add(action, observation);
+
+			RandomSeed(seed);
+			batch->Action[live] = action;
+			StepBatch(*batch);
+			assert(batch->Observation[live] == observation);
+			assert(batch->Reward[live] == reward);
+			assert(bool(batch->Terminal[live]) == terminal);
+			for (int lane = 0; lane < size; ++lane)
+				assert(lane == live || (batch->Terminal[lane] && batch->Reward[lane] == 0));
+		}
+
+		FreeState(state);
+		delete batch;
+	}
+}
+
+size_t SIMULATOR::GetMemoryUsage() const
+{
+	return 0;
+}
+
 void SIMULATOR::Validate(const STATE& state) const
 {
 }
@@ -59,24 +204,38 @@ void SIMULATOR::GeneratePreferred(const STATE& state, const HISTORY& history,
 {
 }
 
+const ACTION_SET* SIMULATOR::LegalActions(const STATE& state,
+	const STATUS& status) const
+{
+	return 0;
+}
+
 int SIMULATOR::SelectRandom(const STATE& state, const HISTORY& history,
 	const STATUS& status) const
 {
-	static vector<int> actions;
 	if (Knowledge.RolloutLevel >= KNOWLEDGE::SMART)
 	{
-		actions.clear();
-		GeneratePreferred(state, history, actions, status);
-		if (!actions.empty())
-			return actions[Random(actions.size())];
+		ActionBuffer.clear();
+		GeneratePreferred(state, history, ActionBuffer, status);
+		if (!ActionBuffer.empty())
+			return ActionBuffer[Random(ActionBuffer.size())];
 	}
 
 	if (Knowledge.RolloutLevel >= KNOWLEDGE::LEGAL)
 	{
-		actions.clear();
-		GenerateLegal(state, history, actions, status);
-		if (!actions.empty())
-			return actions[Random(actions.size())];
+		const ACTION_SET* legal = LegalActions(state, status);
+		if (legal)
+		{
+			if (!legal->Empty())
+				return legal->Sample();
+		}
+		else
+		{
+			ActionBuffer.clear();
+			GenerateLegal(state, history, ActionBuffer, status);
+			if (!ActionBuffer.empty())
+				return ActionBuffer[Random(ActionBuffer.size())];
+		}
 	}
 
 	return Random(NumActions);
@@ -85,8 +244,6 @@ int SIMULATOR::SelectRandom(const STATE& state, const HISTORY& history,
 void SIMULATOR::Prior(const STATE* state, const HISTORY& history,
 	VNODE* vnode, const STATUS& status) const
 {
-	static vector<int> actions;
-
 	if (Knowledge.TreeLevel == KNOWLEDGE::PURE || state == 0)
 	{
 		vnode->SetChildren(0, 0);
@@ -99,24 +256,37 @@ void SIMULATOR::Prior(const STATE* state, const HISTORY& history,
 
 	if (Knowledge.TreeLevel >= KNOWLEDGE::LEGAL)
 	{
-		actions.clear();
-		GenerateLegal(*state, history, actions, status);
-
-		for (vector<int>::const_iterator i_action = actions.begin(); i_action != actions.end(); ++i_action)
+		const ACTION_SET* legal = LegalActions(*state, status);
+		if (legal)
 		{
-			int a = *i_action;
-			QNODE& qnode = vnode->Child(a);
-			qnode.Value.Set(0, 0);
-			qnode.AMAF.Set(0, 0);
+			for (int a = legal->First(); a >= 0; a = legal->Next(a))
+			{
+				QNODE& qnode = vnode->Child(a);
+				qnode.Value.Set(0, 0);
+				qnode.AMAF.Set(0, 0);
+			}
+		}
+		else
+		{
+			ActionBuffer.clear();
+			GenerateLegal(*state, history, ActionBuffer, status);
+
+			for (vector<int>::const_iterator i_action = ActionBuffer.begin(); i_action != ActionBuffer.end(); ++i_action)
+			{
+				int a = *i_action;
+				QNODE& qnode = vnode->Child(a);
+				qnode.Value.Set(0, 0);
+				qnode.AMAF.Set(0, 0);
+			}
 		}
 	}
 
 	if (Knowledge.TreeLevel >= KNOWLEDGE::SMART)
 	{
-		actions.clear();
-		GeneratePreferred(*state, history, actions, status);
+		ActionBuffer.clear();
+		GeneratePreferred(*state, history, ActionBuffer, status);
 
-		for (vector<int>::const_iterator i_action = actions.begin(); i_action != actions.end(); ++i_action)
+		for (vector<int>::const_iterator i_action = ActionBuffer.begin(); i_action != ActionBuffer.end(); ++i_action)
 		{
 			int a = *i_action;
 			QNODE& qnode = vnode->Child(a);
@@ -135,7 +305,7 @@ void SIMULATOR::AlphaValue(const QNODE& qnode, double& q, int& n) const
 {
 }
 
-void SIMULATOR::UpdateAlpha(QNODE& qnode, const STATE& state) const
+void SIMULATOR::UpdateAlpha(QNODE& qnode, const STATE& state, int action) const
 {
 }
 
@@ -170,7 +340,7 @@ double SIMULATOR::GetHorizon(double accuracy, int undiscountedHorizon) const
 	return log(accuracy) / log(Discount);
 }
 
-void SIMULATOR::GenerateActionSpace(const STATE& state, const HISTORY& history,
+const ACTION_SET* SIMULATOR::GenerateActionSpace(const STATE& state, const HISTORY& history,
 	std::vector<int>& actions, const STATUS& status, const bool preferred) const
 {
 	actions.clear();
@@ -180,6 +350,10 @@ void SIMULATOR::GenerateActionSpace(const STATE& state, const HISTORY& history,
 	}
 	if(actions.empty())
 	{
+		const ACTION_SET* legal = LegalActions(state, status);
+		if (legal)
+			return legal;
 		GenerateLegal(state, history, actions, status);
 	}
+	return 0;
 }
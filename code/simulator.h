@@ -1,6 +1,7 @@
 #ifndef SIMULATOR_H
 #define SIMULATOR_H
 
+#include "actionset.h"
 #include "history.h"
 #include "node.h"
 #include "utils.h"
@@ -13,6 +14,28 @@ class STATE : public MEMORY_OBJECT
 {
 };
 
+//-----------------------------------------------------------------------------
+// Lanes of states advanced in lockstep by SIMULATOR::StepBatch
+// Actions, observations, rewards and terminal flags are parallel arrays
+// indexed by lane. Simulators with a native batch derive from this class
+// and store their state variables as arrays indexed by lane as well
+
+class STATE_BATCH
+{
+public:
+
+	STATE_BATCH(int size);
+	virtual ~STATE_BATCH();
+
+	bool AllTerminal() const;
+
+	int Size;
+	std::vector<int> Action;
+	std::vector<int> Observation;
+	std::vector<double> Reward;
+	std::vector<unsigned char> Terminal; // Terminal lanes are not stepped
+};
+
 class SIMULATOR
 {
 public:
@@ -85,9 +108,26 @@ public:
 	// Create new state and copy argument (must be same type)
 	virtual STATE* Copy(const STATE& state) const = 0;
 
+	// Batched simulation: create a batch, load a state into each lane, then
+	// select actions and step all lanes at once. The default batch holds
+	// a copy of the state and history of each lane and steps it through Step.
+	// Native batches only record history if their knowledge depends on it
+	virtual STATE_BATCH* CreateBatch(int size) const;
+	virtual void LoadBatch(STATE_BATCH& batch, int lane, const STATE& state,
+		const HISTORY& history) const;
+	virtual void SelectRandomBatch(STATE_BATCH& batch, const STATUS& status) const;
+	virtual void StepBatch(STATE_BATCH& batch) const;
+
+	// Check StepBatch against Step: each lane in turn is stepped alone, the
+	// others being terminal, through the same legal actions and seeds
+	void UnitTestBatch(int size, int numSteps) const;
+
 	// Sanity check
 	virtual void Validate(const STATE& state) const;
 
+	// Bytes held by the state pool, 0 if states are not pooled
+	virtual size_t GetMemoryUsage() const;
+
 	// Modify state stochastically to some related state
 	virtual bool LocalMove(STATE& state, const HISTORY& history,
 		int stepObs, const STATUS& status) const;
@@ -110,10 +150,15 @@ public:
 	virtual void GeneratePreferred(const STATE& state, const HISTORY& history,
 		std::vector<int>& actions, const STATUS& status) const;
 
+	// Legal actions maintained incrementally by the domain (optional)
+	// Returns 0 if the domain does not keep a legal action set
+	virtual const ACTION_SET* LegalActions(const STATE& state,
+		const STATUS& status) const;
+
 	// For explicit POMDP computation only
 	virtual bool HasAlpha() const;
 	virtual void AlphaValue(const QNODE& qnode, double& q, int& n) const;
-	virtual void UpdateAlpha(QNODE& qnode, const STATE& state) const;
+	virtual void UpdateAlpha(QNODE& qnode, const STATE& state, int action) const;
 
 	// Textual display
 	virtual void DisplayBeliefs(const BELIEF_STATE& beliefState,
@@ -131,7 +176,11 @@ public:
 	double GetDiscount() const { return Discount; }
 	double GetRewardRange() const { return RewardRange; }
 	double GetHorizon(double accuracy, int undiscountedHorizon = 100) const;
-	void GenerateActionSpace(const STATE& state, const HISTORY& history,
+	// Preferred actions, if asked for and there are any, or else the legal
+	// actions. When those are the domain's legal action set, it is returned
+	// for the caller to iterate in place and actions is left empty;
+	// otherwise actions is filled and 0 is returned
+	const ACTION_SET* GenerateActionSpace(const STATE& state, const HISTORY& history,
 		std::vector<int>& actions, const STATUS& status, const bool preferred) const;
 
 protected:
@@ -139,6 +188,10 @@ protected:
 	int NumActions, NumObservations;
 	double Discount, RewardRange;
 	KNOWLEDGE Knowledge;
+
+private:
+
+	mutable std::vector<int> ActionBuffer;
 };
 
 #endif // SIMULATOR_H
@@ -0,0 +1,53 @@
+#include "utils.h"
+#include <iostream>
+#include "statistic.h"
+#include <string.h>
+
+//----------------------------------------------------------------------------
+
+void HISTOGRAM::Merge(const HISTOGRAM& histogram)
+{
+	for (int bucket = 0; bucket < NumBuckets; ++bucket)
+		Counts[bucket] += histogram.Counts[bucket];
+	Count += histogram.Count;
+	Total += histogram.Total;
+	if (histogram.Max > Max)
+		Max = histogram.Max;
+}
+
+void HISTOGRAM::Clear()
+{
+	memset(Counts, 0, sizeof(Counts));
+	Count = 0;
+	Total = 0;
+	Max = 0;
+}
+
+double HISTOGRAM::GetPercentile(double p) const
+{
+	if (Count == 0)
+		return 0;
+	long long rank = (long long) ceil(p * Count);
+	if (rank < 1)
+		rank = 1;
+	long long seen = 0;
+	for (int bucket = 0; bucket < NumBuckets; ++bucket)
+	{
+		seen += Counts[bucket];
+		if (seen >= rank)
+			return (UpperBound(bucket) < Max ? UpperBound(bucket) : Max) * 1e-9;
+	}
+	return GetMax();
+}
+
+uint64_t HISTOGRAM::UpperBound(int bucket)
+{
+	if (bucket < SubBuckets)
+		return bucket;
+	int octave = bucket / SubBuckets + SubBucketBits - 1;
+	int sub = bucket % SubBuckets;
+	uint64_t width = (uint64_t) 1 << (octave - SubBucketBits);
+	return (SubBuckets + sub) * width + width - 1;
+}
+
+//----------------------------------------------------------------------------
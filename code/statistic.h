@@ -4,6 +4,7 @@
 #include <math.h>
 #include <string>
 #include <assert.h>
+#include <stdint.h>
 
 //----------------------------------------------------------------------------
 
@@ -117,4 +118,88 @@ inline void STATISTIC::Print(const std::string& name, std::ostream& ostr) const
 
 //----------------------------------------------------------------------------
 
+// Durations in seconds, counted in logarithmic buckets of whole nanoseconds:
+// SubBuckets buckets per power of two, so percentiles are within one part
+// in SubBuckets. Histograms merge by adding counts, so they can be kept
+// per thread or per run and combined afterwards
+
+class HISTOGRAM
+{
+public:
+
+	HISTOGRAM();
+
+	void Add(double seconds);
+	void Merge(const HISTOGRAM& histogram);
+	void Clear();
+	long long GetCount() const;
+	double GetTotal() const;
+	double GetMean() const;
+	double GetMax() const;
+
+	// Upper bound of the bucket holding the value of rank ceil(p * count)
+	double GetPercentile(double p) const;
+
+private:
+
+	static const int SubBucketBits = 3;
+	static const int SubBuckets = 1 << SubBucketBits;
+	static const int NumBuckets = (64 - SubBucketBits + 1) * SubBuckets;
+
+	static int Bucket(uint64_t nanoseconds);
+	static uint64_t UpperBound(int bucket);
+
+	long long Counts[NumBuckets];
+	long long Count;
+	uint64_t Total, Max;
+};
+
+inline HISTOGRAM::HISTOGRAM()
+{
+	Clear();
+}
+
+inline void HISTOGRAM::Add(double seconds)
+{
+	uint64_t nanoseconds = seconds > 0 ? (uint64_t) (seconds * 1e9 + 0.5) : 0;
+	++Counts[Bucket(nanoseconds)];
+	++Count;
+	Total += nanoseconds;
+	if (nanoseconds > Max)
+		Max = nanoseconds;
+}
+
+inline long long HISTOGRAM::GetCount() const
+{
+	return Count;
+}
+
+inline double HISTOGRAM::GetTotal() const
+{
+	return Total * 1e-9;
+}
+
+inline double HISTOGRAM::GetMean() const
+{
+	return Count ? GetTotal() / Count : 0;
+}
+
+inline double HISTOGRAM::GetMax() const
+{
+	return Max * 1e-9;
+}
+
+// Values below SubBuckets have a bucket each, above that the bucket is
+// the octave of the value and its next SubBucketBits bits
+inline int HISTOGRAM::Bucket(uint64_t nanoseconds)
+{
+	if (nanoseconds < SubBuckets)
+		return (int) nanoseconds;
+	int octave = 63 - __builtin_clzll(nanoseconds);
+	int sub = (int) (nanoseconds >> (octave - SubBucketBits)) & (SubBuckets - 1);
+	return (octave - SubBucketBits + 1) * SubBuckets + sub;
+}
+
+//----------------------------------------------------------------------------
+
 #endif // STATISTIC
@@ -0,0 +1,826 @@
+#include "tabularpomdp.h"
+#include "beliefstate.h"
+#include "utils.h"
+#include <fstream>
+#include <sstream>
+#include <map>
+
+using namespace std;
+using namespace UTILS;
+
+//-----------------------------------------------------------------------------
+// Reader for Cassandra's .pomdp format
+// Models are collected into sparse maps first, because later entries
+// override earlier ones, and then compiled into compressed rows
+
+class TABULAR_POMDP::PARSER
+{
+public:
+
+	struct RULE
+	{
+		int Action, State, NextState, Observation; // -1 for wildcards
+		double Value;
+	};
+
+	PARSER(const string& filename);
+
+	void Parse();
+
+	int NumStates, NumActions, NumObservations;
+	double Discount;
+	bool Cost;
+	vector<string> StateNames, ActionNames, ObservationNames;
+	vector<double> Start;
+	vector<map<int, double> > T;	// Rows indexed by state * NumActions + action
+	vector<map<int, double> > O;	// Rows indexed by action * NumStates + state
+	vector<RULE> Rules;
+
+private:
+
+	void Fail(const string& message) const;
+	bool AtEnd() const { return Pos >= (int) Tokens.size(); }
+	const string& Peek(int offset = 0) const;
+	string Next();
+	void Expect(const string& token);
+	bool AtKeyword(int offset = 0) const;
+	bool IsNumber(const string& token) const;
+	double Number();
+	int Element(const vector<string>& names, int count);
+	void Elements(int& count, vector<string>& names);
+	void ParseStart();
+	void ParseTransition();
+	void ParseObservation();
+	void ParseReward();
+	void SetRow(map<int, double>& row, int column, double prob);
+	void Prepare();
+
+	string Filename;
+	vector<string> Tokens;
+	int Pos;
+	bool Prepared;
+};
+
+TABULAR_POMDP::PARSER::PARSER(const string& filename)
+	: NumStates(0),
+	NumActions(0),
+	NumObservations(0),
+	Discount(1.0),
+	Cost(false),
+	Filename(filename),
+	Pos(0),
+	Prepared(false)
+{
+	ifstream file(filename.c_str());
+	if (!file)
+		Fail("could not open file");
+
+	string line;
+	while (getline(file, line))
+	{
+		// Colons separate tokens even without surrounding spaces
+		string spaced;
+		for (size_t i = 0; i < line.size() && line[i] != '#'; ++i)
+		{
+			if (line[i] == ':')
+				spaced += " : ";
+			else
+				spaced += line[i];
+		}
+		istringstream words(spaced);
+		string word;
+		while (words >> word)
+			Tokens.push_back(word);
+	}
+}
+
+void TABULAR_POMDP::PARSER::Fail(const string& message) const
+{
+	cout << "Error reading " << Filename << ": " << message;
+	if (Pos < (int) Tokens.size())
+		cout << " near '" << Tokens[Pos] << "'";
+	cout << endl;
+	exit(1);
+}
+
+const string& TABULAR_POMDP::PARSER::Peek(int offset) const
+{
+	static const string end;
+	return Pos + offset < (int) Tokens.size() ? Tokens[Pos + offset] : end;
+}
+
+string TABULAR_POMDP::PARSER::Next()
+{
+	if (AtEnd())
+		Fail("unexpected end of file");
+	return Tokens[Pos++];
+}
+
+void TABULAR_POMDP::PARSER::Expect(const string& token)
+{
+	if (Next() != token)
+		Fail("expected '" + token + "'");
+}
+
+bool TABULAR_POMDP::PARSER::AtKeyword(int offset) const
+{
+	const string& token = Peek(offset);
+	const string& next = Peek(offset + 1);
+	if (token == "start")
+		return next == ":" || next == "include" || next == "exclude";
+	return (token == "discount" || token == "values" || token == "states"
+		|| token == "actions" || token == "observations"
+		|| token == "T" || token == "O" || token == "R")
+		&& next == ":";
+}
+
+bool TABULAR_POMDP::PARSER::IsNumber(const string& token) const
+{
+	char* end;
+	strtod(token.c_str(), &end);
+	return !token.empty() && *end == 0;
+}
+
+double TABULAR_POMDP::PARSER::Number()
+{
+	string token = Next();
+	if (!IsNumber(token))
+		Fail("expected a number");
+	return atof(token.c_str());
+}
+
+int TABULAR_POMDP::PARSER::Element(const vector<string>& names, int count)
+{
+	string token = Next();
+	if (token == "*")
+		return -1;
+	for (size_t i = 0; i < names.size(); ++i)
+		if (names[i] == token)
+			return i;
+	if (!IsNumber(token))
+		Fail("unknown name");
+	int index = atoi(token.c_str());
+	if (index < 0 || index >= count)
+		Fail("index out of range");
+	return index;
+}
+
+void TABULAR_POMDP::PARSER::Elements(int& count, vector<string>& names)
+{
+	Expect(":");
+	names.clear();
+	if (IsNumber(Peek()) && (Pos + 1 == (int) Tokens.size() || AtKeyword(1)))
+	{
+		count = atoi(Next().c_str());
+		return;
+	}
+	while (!AtEnd() && !AtKeyword())
+		names.push_back(Next());
+	count = names.size();
+}
+
+void TABULAR_POMDP::PARSER::Parse()
+{
+	while (!AtEnd())
+	{
+		if (!AtKeyword())
+			Fail("expected a keyword");
+		string keyword = Next();
+		if (keyword == "discount")
+		{
+			Expect(":");
+			Discount = Number();
+		}
+		else if (keyword == "values")
+		{
+			Expect(":");
+			string values = Next();
+			if (values != "reward" && values != "cost")
+				Fail("values must be reward or cost");
+			Cost = values == "cost";
+		}
+		else if (keyword == "states")
+			Elements(NumStates, StateNames);
+		else if (keyword == "actions")
+			Elements(NumActions, ActionNames);
+		else if (keyword == "observations")
+			Elements(NumObservations, ObservationNames);
+		else if (keyword == "start")
+			ParseStart();
+		else if (keyword == "T")
+			ParseTransition();
+		else if (keyword == "O")
+			ParseObservation();
+		else if (keyword == "R")
+			ParseReward();
+	}
+	Prepare();
+	if (Start.empty())
+		Start.assign(NumStates, 1.0 / NumStates);
+}
+
+void TABULAR_POMDP::PARSER::Prepare()
+{
+	if (Prepared)
+		return;
+	if (NumStates <= 0 || NumActions <= 0 || NumObservations <= 0)
+		Fail("states, actions and observations must precede the model");
+	T.resize(NumStates * NumActions);
+	O.resize(NumActions * NumStates);
+	Prepared = true;
+}
+
+void TABULAR_POMDP::PARSER::ParseStart()
+{
+	Prepare();
+	Start.assign(NumStates, 0);
+	string mode = Next();
+	if (mode == "include" || mode == "exclude")
+	{
+		Expect(":");
+		vector<bool> listed(NumStates, false);
+		while (!AtEnd() && !AtKeyword())
+			listed[Element(StateNames, NumStates)] = true;
+		for (int s = 0; s < NumStates; ++s)
+			Start[s] = listed[s] == (mode == "include");
+		return;
+	}
+
+	if (Peek() == "uniform")
+	{
+		Next();
+		Start.assign(NumStates, 1.0);
+	}
+	else if (!IsNumber(Peek()) || (NumStates > 1 && (Pos + 1 == (int) Tokens.size() || AtKeyword(1))))
+		Start[Element(StateNames, NumStates)] = 1.0;
+	else
+		for (int s = 0; s < NumStates; ++s)
+			Start[s] = Number();
+}
+
+void TABULAR_POMDP::PARSER::SetRow(map<int, double>& row, int column, double prob)
+{
+	if (prob == 0)
+		row.erase(column);
+	else
+		row[column] = prob;
+}
+
+void TABULAR_POMDP::PARSER::ParseTransition()
+{
+	Prepare();
+	Expect(":");
+	int a = Element(ActionNames, NumActions);
+	int s = -1, sn = -1;
+	bool hasState = Peek() == ":";
+	if (hasState)
+	{
+		Next();
+		s = Element(StateNames, NumStates);
+	}
+	bool hasNext = hasState && Peek() == ":";
+	if (hasNext)
+	{
+		Next();
+		sn = Element(StateNames, NumStates);
+	}
+
+	// Values for each matching (action, state) row, from next token onwards
+	vector<double> values;
+	int columns = hasNext ? 1 : NumStates;
+	int rows = hasState ? 1 : NumStates;
+	if (!hasNext && Peek() == "uniform")
+	{
+		Next();
+		values.assign(rows * columns, 1.0 / NumStates);
+	}
+	else if (!hasState && Peek() == "identity")
+	{
+		Next();
+		values.assign(rows * columns, 0);
+		for (int i = 0; i < NumStates; ++i)
+			values[i * NumStates + i] = 1.0;
+	}
+	else
+	{
+		for (int i = 0; i < rows * columns; ++i)
+			values.push_back(Number());
+	}
+
+	for (int ai = 0; ai < NumActions; ++ai)
+	{
+		if (a >= 0 && ai != a)
+			continue;
+		for (int si = 0; si < NumStates; ++si)
+		{
+			if (s >= 0 && si != s)
+				continue;
+			map<int, double>& row = T[si * NumActions + ai];
+			int r = hasState ? 0 : si;
+			for (int sni = 0; sni < NumStates; ++sni)
+			{
+				if (hasNext && sn >= 0 && sni != sn)
+					continue;
+				SetRow(row, sni, values[r * columns + (hasNext ? 0 : sni)]);
+			}
+		}
+	}
+}
+
+void TABULAR_POMDP::PARSER::ParseObservation()
+{
+	Prepare();
+	Expect(":");
+	int a = Element(ActionNames, NumActions);
+	int sn = -1, o = -1;
+	bool hasState = Peek() == ":";
+	if (hasState)
+	{
+		Next();
+		sn = Element(StateNames, NumStates);
+	}
+	bool hasObs = hasState && Peek() == ":";
+	if (hasObs)
+	{
+		Next();
+		o = Element(ObservationNames, NumObservations);
+	}
+
+	vector<double> values;
+	int columns = hasObs ? 1 : NumObservations;
+	int rows = hasState ? 1 : NumStates;
+	if (!hasObs && Peek() == "uniform")
+	{
+		Next();
+		values.assign(rows * columns, 1.0 / NumObservations);
+	}
+	else
+	{
+		for (int i = 0; i < rows * columns; ++i)
+			values.push_back(Number());
+	}
+
+	for (int ai = 0; ai < NumActions; ++ai)
+	{
+		if (a >= 0 && ai != a)
+			continue;
+		for (int sni = 0; sni < NumStates; ++sni)
+		{
+			if (sn >= 0 && sni != sn)
+				continue;
+			map<int, double>& row = O[ai * NumStates + sni];
+			int r = hasState ? 0 : sni;
+			for (int oi = 0; oi < NumObservations; ++oi)
+			{
+				if (hasObs && o >= 0 && oi != o)
+					continue;
+				SetRow(row, oi, values[r * columns + (hasObs ? 0 : oi)]);
+			}
+		}
+	}
+}
+
+void TABULAR_POMDP::PARSER::ParseReward()
+{
+	Prepare();
+	Expect(":");
+	RULE rule;
+	rule.Action = Element(ActionNames, NumActions);
+	Expect(":");
+	rule.State = Element(StateNames, NumStates);
+	rule.NextState = rule.Observation = -1;
+	bool hasNext = Peek() == ":";
+	if (hasNext)
+	{
+		Next();
+		rule.NextState = Element(StateNames, NumStates);
+	}
+	bool hasObs = hasNext && Peek() == ":";
+	if (hasObs)
+	{
+		Next();
+		rule.Observation = Element(ObservationNames, NumObservations);
+		rule.Value = Number();
+		Rules.push_back(rule);
+		return;
+	}
+
+	// Row of observation values, or matrix of next state by observation
+	int rows = hasNext ? 1 : NumStates;
+	for (int r = 0; r < rows; ++r)
+	{
+		if (!hasNext)
+			rule.NextState = r;
+		for (int o = 0; o < NumObservations; ++o)
+		{
+			rule.Observation = o;
+			rule.Value = Number();
+			Rules.push_back(rule);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+TABULAR_POMDP::TABULAR_POMDP(const string& filename)
+{
+	PARSER parser(filename);
+	parser.Parse();
+	Compile(parser);
+	InitAlpha();
+}
+
+void TABULAR_POMDP::Compile(PARSER& parser)
+{
+	NumStates = parser.NumStates;
+	NumActions = parser.NumActions;
+	NumObservations = parser.NumObservations;
+	Discount = parser.Discount;
+	StateNames = parser.StateNames;
+	ActionNames = parser.ActionNames;
+	ObservationNames = parser.ObservationNames;
+
+	// Compress each model into rows with alias tables
+	SPARSE* models[2] = { &TransitionModel, &ObservationModel };
+	vector<map<int, double> >* rows[2] = { &parser.T, &parser.O };
+	for (int m = 0; m < 2; ++m)
+	{
+		SPARSE& model = *models[m];
+		model.Start.push_back(0);
+		for (size_t r = 0; r < rows[m]->size(); ++r)
+		{
+			const map<int, double>& row = (*rows[m])[r];
+			if (row.empty())
+			{
+				cout << "Error reading model: " << (m == 0 ? "transition" : "observation")
+					<< " row " << r << " is empty" << endl;
+				exit(1);
+			}
+			// The alias tables need every row to be a distribution
+			double sum = 0;
+			for (map<int, double>::const_iterator i = row.begin(); i != row.end(); ++i)
+			{
+				if (i->second < 0)
+				{
+					cout << "Error reading model: " << (m == 0 ? "transition" : "observation")
+						<< " row " << r << " has a negative probability" << endl;
+					exit(1);
+				}
+				model.Index.push_back(i->first);
+				model.Prob.push_back(i->second);
+				sum += i->second;
+			}
+			if (fabs(sum - 1) > 1e-6)
+			{
+				cout << "Error reading model: " << (m == 0 ? "transition" : "observation")
+					<< " row " << r << " sums to " << sum << ", not 1" << endl;
+				exit(1);
+			}
+			model.Start.push_back(model.Index.size());
+		}
+		model.Threshold.resize(model.Index.size());
+		model.Alias.resize(model.Index.size());
+		for (size_t r = 0; r + 1 < model.Start.size(); ++r)
+		{
+			int start = model.Start[r], size = model.Start[r + 1] - start;
+			BuildAliasTable(&model.Prob[start], size,
+				&model.Threshold[start], &model.Alias[start]);
+		}
+	}
+
+	// Rewards of each transition entry, averaged over observations
+	// Rules are bucketed by start state, and later rules take priority
+	vector<vector<int> > stateRules(NumStates);
+	vector<int> wildRules;
+	for (size_t i = 0; i < parser.Rules.size(); ++i)
+	{
+		if (parser.Rules[i].State >= 0)
+			stateRules[parser.Rules[i].State].push_back(i);
+		else
+			wildRules.push_back(i);
+	}
+
+	double minReward = +Infinity, maxReward = -Infinity;
+	Rewards.resize(TransitionModel.Index.size());
+	ExpectedRewards.assign(NumStates * NumActions, 0);
+	vector<int> candidates, matches;
+	for (int s = 0; s < NumStates; ++s)
+	{
+		candidates.resize(stateRules[s].size() + wildRules.size());
+		merge(stateRules[s].begin(), stateRules[s].end(),
+			wildRules.begin(), wildRules.end(), candidates.begin());
+		for (int a = 0; a < NumActions; ++a)
+		{
+			int row = s * NumActions + a;
+			for (int k = TransitionModel.Start[row]; k < TransitionModel.Start[row + 1]; ++k)
+			{
+				int sn = TransitionModel.Index[k];
+				matches.clear();
+				bool perObservation = false;
+				for (size_t c = 0; c < candidates.size(); ++c)
+				{
+					const PARSER::RULE& rule = parser.Rules[candidates[c]];
+					if ((rule.Action < 0 || rule.Action == a)
+						&& (rule.NextState < 0 || rule.NextState == sn))
+					{
+						matches.push_back(candidates[c]);
+						perObservation |= rule.Observation >= 0;
+					}
+				}
+
+				double reward = 0;
+				if (!perObservation)
+				{
+					if (!matches.empty())
+						reward = parser.Rules[matches.back()].Value;
+				}
+				else
+				{
+					int orow = a * NumStates + sn;
+					for (int j = ObservationModel.Start[orow]; j < ObservationModel.Start[orow + 1]; ++j)
+					{
+						int o = ObservationModel.Index[j];
+						for (int m = matches.size() - 1; m >= 0; --m)
+						{
+							const PARSER::RULE& rule = parser.Rules[matches[m]];
+							if (rule.Observation < 0 || rule.Observation == o)
+							{
+								reward += ObservationModel.Prob[j] * rule.Value;
+								break;
+							}
+						}
+					}
+				}
+
+				if (parser.Cost)
+					reward = -reward;
+				Rewards[k] = reward;
+				ExpectedRewards[row] += TransitionModel.Prob[k] * reward;
+				minReward = min(minReward, reward);
+				maxReward = max(maxReward, reward);
+			}
+		}
+	}
+	RewardRange = max(maxReward - minReward, 1e-6);
+
+	StartProb = parser.Start;
+	StartThreshold.resize(NumStates);
+	StartAlias.resize(NumStates);
+	BuildAliasTable(&StartProb[0], NumStates, &StartThreshold[0], &StartAlias[0]);
+}
+
+void TABULAR_POMDP::InitAlpha()
+{
+	// The value of each blind policy, which repeats one action forever,
+	// is an alpha vector and a lower bound on the optimal value function
+	NumAlpha = NumActions;
+	int iterations = (int) ceil(GetHorizon(1e-6));
+	vector<double> alpha(NumAlpha * NumStates), next(NumStates);
+	for (int a = 0; a < NumActions; ++a)
+	{
+		double* alphaA = &alpha[a * NumStates];
+		for (int s = 0; s < NumStates; ++s)
+			alphaA[s] = ExpectedReward(s, a);
+		for (int i = 1; i < iterations; ++i)
+		{
+			double change = 0;
+			for (int s = 0; s < NumStates; ++s)
+			{
+				ROW t = Transitions(s, a);
+				double v = 0;
+				for (int k = 0; k < t.Size; ++k)
+					v += t.Prob[k] * alphaA[t.Index[k]];
+				next[s] = ExpectedReward(s, a) + Discount * v;
+				change = max(change, fabs(next[s] - alphaA[s]));
+			}
+			copy(next.begin(), next.end(), alphaA);
+			if (change < 1e-6 * RewardRange)
+				break;
+		}
+	}
+
+	// Project each alpha vector back through each action and observation:
+	// g(s, a, o) = sum_s' T(s' | s, a) O(o | a, s') alpha(s')
+	AlphaProjection.assign(NumActions * NumStates * NumObservations * NumAlpha, 0);
+	for (int a = 0; a < NumActions; ++a)
+	{
+		for (int s = 0; s < NumStates; ++s)
+		{
+			double* g = &AlphaProjection[(a * NumStates + s) * NumObservations * NumAlpha];
+			ROW t = Transitions(s, a);
+			for (int k = 0; k < t.Size; ++k)
+			{
+				int sn = t.Index[k];
+				ROW o = Observations(a, sn);
+				for (int j = 0; j < o.Size; ++j)
+				{
+					double p = t.Prob[k] * o.Prob[j];
+					double* go = g + o.Index[j] * NumAlpha;
+					for (int i = 0; i < NumAlpha; ++i)
+						go[i] += p * alpha[i * NumStates + sn];
+				}
+			}
+		}
+	}
+}
+
+bool TABULAR_POMDP::HasAlpha() const
+{
+	return true;
+}
+
+void TABULAR_POMDP::UpdateAlpha(QNODE& qnode, const STATE& state, int action) const
+{
+	// Accumulating the projections of each sampled state is the dot product
+	// of the projections with the empirical belief at this node
+	const TABULAR_STATE& tstate = safe_cast<const TABULAR_STATE&>(state);
+	ALPHA& alpha = qnode.CreateAlpha();
+	int size = NumObservations * NumAlpha;
+	if (alpha.AlphaSum.empty())
+		alpha.AlphaSum.assign(size, 0);
+
+	const double* g = &AlphaProjection[(action * NumStates + tstate.State) * size];
+	double* sum = &alpha.AlphaSum[0];
+	for (int i = 0; i < size; ++i)
+		sum[i] += g[i];
+	alpha.RewardSum += ExpectedReward(tstate.State, action);
+	alpha.Count++;
+}
+
+void TABULAR_POMDP::AlphaValue(const QNODE& qnode, double& q, int& n) const
+{
+	// Q(b, a) = R(b, a) + gamma * sum_o max_alpha b . g(a, o, alpha)
+	const ALPHA* alpha = qnode.Alpha();
+	if (!alpha || alpha->Count == 0)
+	{
+		q = 0;
+		n = 0;
+		return;
+	}
+
+	double future = 0;
+	for (int o = 0; o < NumObservations; ++o)
+	{
+		const double* sum = &alpha->AlphaSum[o * NumAlpha];
+		double best = sum[0];
+		for (int i = 1; i < NumAlpha; ++i)
+			best = max(best, sum[i]);
+		future += best;
+	}
+	n = alpha->Count;
+	q = (alpha->RewardSum + Discount * future) / n;
+}
+
+int TABULAR_POMDP::SPARSE::Sample(int row) const
+{
+	int start = Start[row];
+	return Index[start + SampleAlias(&Threshold[start], &Alias[start], Start[row + 1] - start)];
+}
+
+TABULAR_POMDP::ROW TABULAR_POMDP::Transitions(int state, int action) const
+{
+	int row = state * NumActions + action;
+	int start = TransitionModel.Start[row];
+	ROW result = { &TransitionModel.Index[start], &TransitionModel.Prob[start],
+		TransitionModel.Start[row + 1] - start };
+	return result;
+}
+
+TABULAR_POMDP::ROW TABULAR_POMDP::Observations(int action, int state) const
+{
+	int row = action * NumStates + state;
+	int start = ObservationModel.Start[row];
+	ROW result = { &ObservationModel.Index[start], &ObservationModel.Prob[start],
+		ObservationModel.Start[row + 1] - start };
+	return result;
+}
+
+STATE* TABULAR_POMDP::Copy(const STATE& state) const
+{
+	const TABULAR_STATE& tstate = safe_cast<const TABULAR_STATE&>(state);
+	TABULAR_STATE* newstate = MemoryPool.Allocate();
+	newstate->State = tstate.State;
+	return newstate;
+}
+
+void TABULAR_POMDP::Validate(const STATE& state) const
+{
+	const TABULAR_STATE& tstate = safe_cast<const TABULAR_STATE&>(state);
+	assert(tstate.State >= 0 && tstate.State < NumStates);
+}
+
+STATE* TABULAR_POMDP::CreateStartState() const
+{
+	TABULAR_STATE* tstate = MemoryPool.Allocate();
+	tstate->State = SampleAlias(&StartThreshold[0], &StartAlias[0], NumStates);
+	return tstate;
+}
+
+void TABULAR_POMDP::FreeState(STATE* state) const
+{
+	TABULAR_STATE* tstate = safe_cast<TABULAR_STATE*>(state);
+	MemoryPool.Free(tstate);
+}
+
+size_t TABULAR_POMDP::GetMemoryUsage() const
+{
+	return MemoryPool.GetMemoryUsage();
+}
+
+bool TABULAR_POMDP::Step(STATE& state, int action,
+	int& observation, double& reward) const
+{
+	TABULAR_STATE& tstate = safe_cast<TABULAR_STATE&>(state);
+	int row = tstate.State * NumActions + action;
+	int start = TransitionModel.Start[row];
+	int k = start + SampleAlias(&TransitionModel.Threshold[start],
+		&TransitionModel.Alias[start], TransitionModel.Start[row + 1] - start);
+	tstate.State = TransitionModel.Index[k];
+	reward = Rewards[k];
+	observation = ObservationModel.Sample(action * NumStates + tstate.State);
+	return false;
+}
+
+void TABULAR_POMDP::DisplayBeliefs(const BELIEF_STATE& beliefState,
+	ostream& ostr) const
+{
+	vector<int> counts(NumStates, 0);
+	for (int i = 0; i < beliefState.GetNumSamples(); i++)
+		counts[safe_cast<const TABULAR_STATE*>(beliefState.GetSample(i))->State]++;
+	for (int s = 0; s < NumStates; s++)
+		if (counts[s])
+			ostr << (StateNames.empty() ? to_string(s) : StateNames[s]) << ": "
+				<< (double)counts[s] / beliefState.GetNumSamples() << endl;
+}
+
+void TABULAR_POMDP::DisplayState(const STATE& state, ostream& ostr) const
+{
+	const TABULAR_STATE& tstate = safe_cast<const TABULAR_STATE&>(state);
+	ostr << "State ";
+	if (StateNames.empty())
+		ostr << tstate.State << endl;
+	else
+		ostr << StateNames[tstate.State] << endl;
+}
+
+void TABULAR_POMDP::DisplayObservation(const STATE& state, int observation, ostream& ostr) const
+{
+	ostr << "Observation ";
+	if (ObservationNames.empty())
+		ostr << observation << endl;
+	else
+		ostr << ObservationNames[observation] << endl;
+}
+
+void TABULAR_POMDP::DisplayAction(int action, ostream& ostr) const
+{
+	ostr << "Action ";
+	if (ActionNames.empty())
+		ostr << action << endl;
+	else
+		ostr << ActionNames[action] << endl;
+}
+
+//-----------------------------------------------------------------------------
+
+void TABULAR_POMDP::UnitTest()
+{
+	TABULAR_POMDP tiger("tiger.pomdp");
+	assert(tiger.GetNumStates() == 2);
+	assert(tiger.GetNumActions() == 3);
+	assert(tiger.GetNumObservations() == 2);
+	assert(tiger.GetDiscount() == 0.95);
+
+	// States and actions by name order: tiger-left, tiger-right and
+	// listen, open-left, open-right
+	assert(tiger.ExpectedReward(0, 0) == -1);
+	assert(tiger.ExpectedReward(0, 1) == -100);
+	assert(tiger.ExpectedReward(0, 2) == 10);
+	assert(tiger.ExpectedReward(1, 1) == 10);
+	assert(tiger.ExpectedReward(1, 2) == -100);
+	ROW listen = tiger.Transitions(1, 0);
+	assert(listen.Size == 1 && listen.Index[0] == 1 && listen.Prob[0] == 1);
+	ROW open = tiger.Transitions(0, 1);
+	assert(open.Size == 2 && open.Prob[0] == 0.5 && open.Prob[1] == 0.5);
+
+	int starts = 0, correct = 0, moved = 0;
+	const int n = 10000;
+	for (int i = 0; i < n; i++)
+	{
+		TABULAR_STATE& state = safe_cast<TABULAR_STATE&>(*tiger.CreateStartState());
+		starts += state.State;
+		int observation;
+		double reward;
+		int start = state.State;
+		assert(!tiger.Step(state, 0, observation, reward));
+		assert(reward == -1 && state.State == start);
+		correct += observation == start;
+		tiger.Step(state, start == 0 ? 2 : 1, observation, reward);
+		assert(reward == 10);
+		moved += state.State != start;
+		tiger.FreeState(&state);
+	}
+	assert(Near(starts, n / 2, 250));
+	assert(Near(correct, 0.85 * n, 250));
+	assert(Near(moved, n / 2, 250));
+}
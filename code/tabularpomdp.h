@@ -0,0 +1,108 @@
+#ifndef TABULAR_POMDP_H
+#define TABULAR_POMDP_H
+
+#include "simulator.h"
+#include <string>
+
+class TABULAR_STATE : public STATE
+{
+public:
+
+	int State;
+};
+
+//-----------------------------------------------------------------------------
+// Explicit POMDP loaded from a file in Cassandra's .pomdp format
+// Transition and observation distributions are stored as compressed sparse
+// rows, each row with an alias table so that Step samples in O(1)
+
+class TABULAR_POMDP : public SIMULATOR
+{
+public:
+
+	TABULAR_POMDP(const std::string& filename);
+
+	virtual STATE* Copy(const STATE& state) const;
+	virtual void Validate(const STATE& state) const;
+	virtual size_t GetMemoryUsage() const;
+	virtual STATE* CreateStartState() const;
+	virtual void FreeState(STATE* state) const;
+	virtual bool Step(STATE& state, int action,
+		int& observation, double& reward) const;
+
+	// One-step lookahead values over alpha vectors of blind policies
+	virtual bool HasAlpha() const;
+	virtual void AlphaValue(const QNODE& qnode, double& q, int& n) const;
+	virtual void UpdateAlpha(QNODE& qnode, const STATE& state, int action) const;
+
+	virtual void DisplayBeliefs(const BELIEF_STATE& beliefState,
+		std::ostream& ostr) const;
+	virtual void DisplayState(const STATE& state, std::ostream& ostr) const;
+	virtual void DisplayObservation(const STATE& state, int observation, std::ostream& ostr) const;
+	virtual void DisplayAction(int action, std::ostream& ostr) const;
+
+	int GetNumStates() const { return NumStates; }
+
+	// Loads the tiger problem from tiger.pomdp in the working directory
+	static void UnitTest();
+
+	// Sparse row of a distribution
+	struct ROW
+	{
+		const int* Index;
+		const double* Prob;
+		int Size;
+	};
+
+	// Successor states of (state, action)
+	ROW Transitions(int state, int action) const;
+
+	// Observations on reaching state with action
+	ROW Observations(int action, int state) const;
+
+	// Expected immediate reward of (state, action)
+	double ExpectedReward(int state, int action) const
+	{
+		return ExpectedRewards[state * NumActions + action];
+	}
+
+protected:
+
+	// Compressed sparse rows with per-row alias tables
+	struct SPARSE
+	{
+		std::vector<int> Start;	// Row r is [Start[r], Start[r + 1])
+		std::vector<int> Index;
+		std::vector<double> Prob;
+		std::vector<double> Threshold;
+		std::vector<int> Alias;
+
+		int Sample(int row) const;
+	};
+
+	class PARSER;
+
+	void Compile(PARSER& parser);
+	void InitAlpha();
+
+	int NumStates;
+	SPARSE TransitionModel;			// Rows indexed by state * NumActions + action
+	SPARSE ObservationModel;		// Rows indexed by action * NumStates + state
+	std::vector<double> Rewards;	// Aligned with transition entries
+	std::vector<double> ExpectedRewards;
+	std::vector<double> StartProb, StartThreshold;
+	std::vector<int> StartAlias;
+	std::vector<std::string> StateNames, ActionNames, ObservationNames;
+
+	// Alpha vectors projected back through each action and observation,
+	// indexed by ((action * NumStates + state) * NumObservations + obs) * NumAlpha + alpha,
+	// so that the projections of one sampled state are contiguous
+	int NumAlpha;
+	std::vector<double> AlphaProjection;
+
+private:
+
+	mutable MEMORY_POOL<TABULAR_STATE> MemoryPool;
+};
+
+#endif // TABULAR_POMDP_H
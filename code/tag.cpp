@@ -1,17 +1,143 @@
 #include "tag.h"
+#include <fstream>
 
 using namespace std;
 using namespace UTILS;
 
-const int TAG::NumCells = 29;
-
 TAG::TAG(int opponents)
 	: NumOpponents(opponents)
 {
+	static const char* DefaultMap[] =
+	{
+		"     ...  ",
+		"     ...  ",
+		"     ...  ",
+		"..........",
+		".........."
+	};
+
+	InitMap(vector<string>(DefaultMap, DefaultMap + 5));
+}
+
+TAG::TAG(int opponents, const string& mapFile)
+	: NumOpponents(opponents)
+{
+	ifstream mapStream(mapFile.c_str());
+	if (!mapStream)
+	{
+		cout << "Could not open tag map " << mapFile << endl;
+		exit(1);
+	}
+
+	vector<string> rows;
+	string row;
+	while (getline(mapStream, row))
+	{
+		if (!row.empty() && row[row.size() - 1] == '\r')
+			row.erase(row.size() - 1);
+		rows.push_back(row);
+	}
+	InitMap(rows);
+}
+
+void TAG::InitMap(const vector<string>& rows)
+{
+	int xsize = 0, ysize = rows.size();
+	for (int r = 0; r < ysize; ++r)
+		xsize = max(xsize, (int)rows[r].size());
+	CellIndex.Resize(xsize, ysize);
+	CellIndex.SetAllValues(-1);
+
+	// Number cells row by row from the bottom of the map
+	CellPos.clear();
+	for (int y = 0; y < ysize; ++y)
+	{
+		const string& row = rows[ysize - 1 - y];
+		for (size_t x = 0; x < row.size(); ++x)
+		{
+			if (row[x] == '.')
+			{
+				CellIndex(x, y) = CellPos.size();
+				CellPos.push_back(COORD(x, y));
+			}
+		}
+	}
+	NumCells = CellPos.size();
+	assert(NumCells > 0);
+
 	NumActions = 5;
 	NumObservations = NumCells + 1;
 	RewardRange = 10 * NumOpponents;
 	Discount = 0.95;
+	AllActions.Resize(NumActions);
+	AllActions.SetAll();
+
+	InitTables();
+}
+
+void TAG::InitTables()
+{
+	MoveTable.resize(NumCells * 4);
+	Corner.resize(NumCells);
+	for (int cell = 0; cell < NumCells; ++cell)
+	{
+		int open = 0;
+		for (int d = 0; d < 4; ++d)
+		{
+			COORD next = CellPos[cell] + COORD::Compass[d];
+			bool inside = CellIndex.Inside(next) && CellIndex(next) >= 0;
+			MoveTable[cell * 4 + d] = inside ? CellIndex(next) : cell;
+			open += inside;
+		}
+
+		// Dead ends and bends, but not straight corridors
+		bool straight =
+			(MoveTable[cell * 4 + COORD::E_NORTH] != cell && MoveTable[cell * 4 + COORD::E_SOUTH] != cell)
+			|| (MoveTable[cell * 4 + COORD::E_EAST] != cell && MoveTable[cell * 4 + COORD::E_WEST] != cell);
+		Corner[cell] = open == 1 || (open == 2 && !straight);
+	}
+
+	// Opponents stay put with probability 0.2, otherwise they pick one of
+	// the directions away from the agent, with some directions counted twice
+	OpponentThreshold.resize(NumCells * NumCells * NumOpponentMoves);
+	OpponentAlias.resize(NumCells * NumCells * NumOpponentMoves);
+	for (int agentCell = 0; agentCell < NumCells; ++agentCell)
+	{
+		for (int oppCell = 0; oppCell < NumCells; ++oppCell)
+		{
+			const COORD& agent = CellPos[agentCell];
+			const COORD& opponent = CellPos[oppCell];
+			double counts[NumOpponentMoves] = { 0 };
+
+			if (opponent.X >= agent.X)
+				counts[COORD::E_EAST]++;
+			if (opponent.Y >= agent.Y)
+				counts[COORD::E_NORTH]++;
+			if (opponent.X <= agent.X)
+				counts[COORD::E_WEST]++;
+			if (opponent.Y <= agent.Y)
+				counts[COORD::E_SOUTH]++;
+			if (opponent.X == agent.X && opponent.Y > agent.Y)
+				counts[COORD::E_NORTH]++;
+			if (opponent.Y == agent.Y && opponent.X > agent.X)
+				counts[COORD::E_EAST]++;
+			if (opponent.X == agent.X && opponent.Y < agent.Y)
+				counts[COORD::E_SOUTH]++;
+			if (opponent.Y == agent.Y && opponent.X < agent.X)
+				counts[COORD::E_WEST]++;
+
+			double total = counts[0] + counts[1] + counts[2] + counts[3];
+			assert(total > 0);
+			double probs[NumOpponentMoves];
+			for (int d = 0; d < 4; ++d)
+				probs[d] = 0.8 * counts[d] / total;
+			probs[4] = 0.2;
+
+			int offset = (agentCell * NumCells + oppCell) * NumOpponentMoves;
+			BuildAliasTable(probs, NumOpponentMoves,
+				&OpponentThreshold[offset], &OpponentAlias[offset]);
+		}
+	}
 }
 
 STATE* TAG::Copy(const STATE& state) const
@@ -25,17 +151,17 @@ STATE* TAG::Copy(const STATE& state) const
 void TAG::Validate(const STATE& state) const
 {
 	const TAG_STATE& tagstate = safe_cast<const TAG_STATE&>(state);
-	assert(Inside(tagstate.AgentPos));
+	assert(tagstate.AgentCell >= 0 && tagstate.AgentCell < NumCells);
 }
 
 STATE* TAG::CreateStartState() const
 {
 	TAG_STATE* tagstate = MemoryPool.Allocate();
 	tagstate->NumAlive = NumOpponents;
-	tagstate->AgentPos = GetCoord(Random(NumCells));
-	tagstate->OpponentPos.clear();
+	tagstate->AgentCell = Random(NumCells);
+	tagstate->OpponentCell.clear();
 	for (int i = 0; i < NumOpponents; ++i)
-		tagstate->OpponentPos.push_back(GetCoord(Random(NumCells)));
+		tagstate->OpponentCell.push_back(Random(NumCells));
 	return tagstate;
 }
 
@@ -45,6 +171,11 @@ void TAG::FreeState(STATE* state) const
 	MemoryPool.Free(tagstate);
 }
 
+size_t TAG::GetMemoryUsage() const
+{
+	return MemoryPool.GetMemoryUsage();
+}
+
 bool TAG::Step(STATE& state, int action,
 	int& observation, double& reward) const
 {
@@ -53,16 +184,15 @@ bool TAG::Step(STATE& state, int action,
 	// Tag action
 	if (action == 4) // tag
 	{
-		observation = GetIndex(tagstate.AgentPos);
 		bool tagged = false;
 		for (int opp = 0; opp < NumOpponents; ++opp)
 		{
-			if (tagstate.OpponentPos[opp] == tagstate.AgentPos)
+			if (tagstate.OpponentCell[opp] == tagstate.AgentCell)
 			{
 				reward = 10;
 				tagged = true;
 				tagstate.NumAlive--;
-				tagstate.OpponentPos[opp] = COORD::Null;
+				tagstate.OpponentCell[opp] = -1;
 			}
 		}
 		if (!tagged)
@@ -80,9 +210,7 @@ bool TAG::Step(STATE& state, int action,
 	if (action < 4)
 	{
 		reward = -1;
-		COORD nextpos = tagstate.AgentPos + COORD::Compass[action];
-		if (Inside(nextpos))
-			tagstate.AgentPos = nextpos;
+		tagstate.AgentCell = MoveTable[tagstate.AgentCell * 4 + action];
 	}
 
 	// Observation occurs in final positions, not start positions
@@ -90,109 +218,150 @@ bool TAG::Step(STATE& state, int action,
 	return tagstate.NumAlive == 0;
 }
 
-inline int TAG::GetObservation(const TAG_STATE& tagstate, int action) const
+STATE_BATCH* TAG::CreateBatch(int size) const
 {
-	int obs = GetIndex(tagstate.AgentPos);
-	if (action < 4)
-		for (int opp = 0; opp < NumOpponents; ++opp)
-			if (tagstate.OpponentPos[opp] == tagstate.AgentPos)
-				obs = NumCells;
-	return obs;
+	// Smart rollouts depend on the history of each lane
+	if (Knowledge.RolloutLevel >= KNOWLEDGE::SMART)
+		return SIMULATOR::CreateBatch(size);
+	return new TAG_BATCH(size, NumOpponents);
 }
 
-inline bool TAG::Inside(const COORD& coord) const
+void TAG::LoadBatch(STATE_BATCH& batch, int lane, const STATE& state,
+	const HISTORY& history) const
 {
-	if (coord.Y >= 2)
-	{
-		return coord.X >= 5 && coord.X < 8 && coord.Y < 5;
-	}
-	else
+	TAG_BATCH* tbatch = dynamic_cast<TAG_BATCH*>(&batch);
+	if (!tbatch)
 	{
-		return coord.X >= 0 && coord.X < 10 && coord.Y >= 0;
+		SIMULATOR::LoadBatch(batch, lane, state, history);
+		return;
 	}
+
+	const TAG_STATE& tagstate = safe_cast<const TAG_STATE&>(state);
+	tbatch->AgentCell[lane] = tagstate.AgentCell;
+	for (int opp = 0; opp < NumOpponents; ++opp)
+		tbatch->OpponentCell[opp * tbatch->Size + lane] = tagstate.OpponentCell[opp];
+	tbatch->NumAlive[lane] = tagstate.NumAlive;
+	tbatch->Terminal[lane] = false;
 }
 
-inline COORD TAG::GetCoord(int index) const
+void TAG::SelectRandomBatch(STATE_BATCH& batch, const STATUS& status) const
 {
-	assert(NumCells == 29);
-	assert(index >= 0 && index < 29);
-	if (index < 20)
-		return COORD(index % 10, index / 10);
-	index -= 20;
-	return COORD(index % 3 + 5, index / 3 + 2);
+	TAG_BATCH* tbatch = dynamic_cast<TAG_BATCH*>(&batch);
+	if (!tbatch)
+	{
+		SIMULATOR::SelectRandomBatch(batch, status);
+		return;
+	}
+
+	// All actions are always legal
+	for (int lane = 0; lane < tbatch->Size; ++lane)
+		tbatch->Action[lane] = Random(NumActions);
 }
 
-inline int TAG::GetIndex(const COORD& coord) const
+void TAG::StepBatch(STATE_BATCH& batch) const
 {
-	assert(coord.X >= 0 && coord.X < 10);
-	assert(coord.Y >= 0 && coord.Y < 5);
-	if (coord.Y < 2)
-		return coord.Y * 10 + coord.X;
-	assert(coord.X >= 5 && coord.X < 8);
-	return 20 + (coord.Y - 2) * 3 + coord.X - 5;
+	TAG_BATCH* tbatch = dynamic_cast<TAG_BATCH*>(&batch);
+	if (!tbatch)
+	{
+		SIMULATOR::StepBatch(batch);
+		return;
+	}
+
+	// Same dynamics as Step, one phase at a time across all lanes
+	int size = tbatch->Size;
+	for (int lane = 0; lane < size; ++lane)
+		tbatch->Reward[lane] = tbatch->Terminal[lane] ? 0
+			: tbatch->Action[lane] == 4 ? -10 : -1;
+
+	for (int opp = 0; opp < NumOpponents; ++opp)
+	{
+		int* oppCell = &tbatch->OpponentCell[opp * size];
+		for (int lane = 0; lane < size; ++lane)
+		{
+			if (tbatch->Terminal[lane] || oppCell[lane] < 0)
+				continue;
+
+			// Tag action
+			if (tbatch->Action[lane] == 4 && oppCell[lane] == tbatch->AgentCell[lane])
+			{
+				tbatch->Reward[lane] = 10;
+				tbatch->NumAlive[lane]--;
+				oppCell[lane] = -1;
+				continue;
+			}
+
+			// Move opponent
+			int offset = (tbatch->AgentCell[lane] * NumCells + oppCell[lane])
+				* NumOpponentMoves;
+			int move = SampleAlias(&OpponentThreshold[offset], &OpponentAlias[offset],
+				NumOpponentMoves);
+			if (move < 4)
+				oppCell[lane] = MoveTable[oppCell[lane] * 4 + move];
+		}
+	}
+
+	// Move action, and observation in final positions
+	for (int lane = 0; lane < size; ++lane)
+	{
+		if (tbatch->Terminal[lane])
+			continue;
+		int action = tbatch->Action[lane];
+		int& agentCell = tbatch->AgentCell[lane];
+		if (action < 4)
+			agentCell = MoveTable[agentCell * 4 + action];
+		tbatch->Observation[lane] = agentCell;
+		tbatch->Terminal[lane] = tbatch->NumAlive[lane] == 0;
+	}
+
+	for (int opp = 0; opp < NumOpponents; ++opp)
+	{
+		const int* oppCell = &tbatch->OpponentCell[opp * size];
+		for (int lane = 0; lane < size; ++lane)
+			if (tbatch->Action[lane] < 4 && oppCell[lane] == tbatch->AgentCell[lane])
+				tbatch->Observation[lane] = NumCells;
+	}
 }
 
-inline bool TAG::IsAlive(const TAG_STATE& tagstate, int opp) const
+// With several opponents, whose cells are laid out opponent by opponent,
+// and with smart rollouts, which fall back to the default batch
+void TAG::UnitTest()
 {
-	return tagstate.OpponentPos[opp].Valid();
+	KNOWLEDGE knowledge;
+	for (int numOpponents = 1; numOpponents <= 3; numOpponents += 2)
+	{
+		TAG tag(numOpponents);
+		for (int level = KNOWLEDGE::PURE; level < KNOWLEDGE::NUM_LEVELS; ++level)
+		{
+			knowledge.RolloutLevel = level;
+			tag.SetKnowledge(knowledge);
+			tag.UnitTestBatch(4, 100);
+		}
+	}
 }
 
-inline bool TAG::IsCorner(const COORD& coord) const
+inline int TAG::GetObservation(const TAG_STATE& tagstate, int action) const
 {
-	if (!Inside(coord))
-		return false;
-	if (coord.Y < 2)
-		return coord.X == 0 || coord.X == 9;
-	else
-		return coord.Y == 4 && (coord.X == 5 || coord.X == 7);
+	int obs = tagstate.AgentCell;
+	if (action < 4)
+		for (int opp = 0; opp < NumOpponents; ++opp)
+			if (tagstate.OpponentCell[opp] == tagstate.AgentCell)
+				obs = NumCells;
+	return obs;
 }
 
-inline COORD TAG::GetRandomCorner() const
+inline bool TAG::IsAlive(const TAG_STATE& tagstate, int opp) const
 {
-	int c = Random(6);
-	switch (c)
-	{
-	case 0: return COORD(0, 0);
-	case 1: return COORD(0, 1);
-	case 2: return COORD(9, 0);
-	case 3: return COORD(9, 1);
-	case 4: return COORD(5, 4);
-	case 5: return COORD(7, 4);
-	}
+	return tagstate.OpponentCell[opp] >= 0;
 }
 
 void TAG::MoveOpponent(TAG_STATE& tagstate, int opp) const
 {
-	const COORD& agent = tagstate.AgentPos;
-	COORD& opponent = tagstate.OpponentPos[opp];
-
-	static vector<int> actions;
-	actions.clear();
-
-	if (opponent.X >= agent.X)
-		actions.push_back(COORD::E_EAST);
-	if (opponent.Y >= agent.Y)
-		actions.push_back(COORD::E_NORTH);
-	if (opponent.X <= agent.X)
-		actions.push_back(COORD::E_WEST);
-	if (opponent.Y <= agent.Y)
-		actions.push_back(COORD::E_SOUTH);
-	if (opponent.X == agent.X && opponent.Y > agent.Y)
-		actions.push_back(COORD::E_NORTH);
-	if (opponent.Y == agent.Y && opponent.X > agent.X)
-		actions.push_back(COORD::E_EAST);
-	if (opponent.X == agent.X && opponent.Y < agent.Y)
-		actions.push_back(COORD::E_SOUTH);
-	if (opponent.Y == agent.Y && opponent.X < agent.X)
-		actions.push_back(COORD::E_WEST);
-
-	assert(!actions.empty());
-	if (Bernoulli(0.8))
-	{
-		int d = actions[Random(actions.size())];
-		if (Inside(opponent + COORD::Compass[d]))
-			opponent = opponent + COORD::Compass[d];
-	}
+	int& oppCell = tagstate.OpponentCell[opp];
+	int offset = (tagstate.AgentCell * NumCells + oppCell) * NumOpponentMoves;
+	int move = SampleAlias(&OpponentThreshold[offset], &OpponentAlias[offset],
+		NumOpponentMoves);
+	if (move < 4)
+		oppCell = MoveTable[oppCell * 4 + move];
 }
 
 bool TAG::LocalMove(STATE& state, const HISTORY& history,
@@ -203,11 +372,11 @@ bool TAG::LocalMove(STATE& state, const HISTORY& history,
 	int opp = Random(NumOpponents);
 	if (!IsAlive(tagstate, opp))
 		return false;
-	tagstate.OpponentPos[opp] = GetCoord(Random(NumCells));
+	tagstate.OpponentCell[opp] = Random(NumCells);
 
 	int realObs = history.Back().Observation;
-	if (realObs < NumCells && realObs != GetIndex(tagstate.AgentPos))
-		tagstate.AgentPos = GetCoord(realObs);
+	if (realObs < NumCells && realObs != tagstate.AgentCell)
+		tagstate.AgentCell = realObs;
 	int simObs = GetObservation(tagstate, history.Back().Action);
 	return simObs == realObs;
 }
@@ -222,7 +391,7 @@ void TAG::GeneratePreferred(const STATE& state, const HISTORY& history,
 		return;
 
 	// If we just saw an opponent and we are in a corner then TAG
-	if (history.Back().Observation == NumCells && IsCorner(tagstate.AgentPos))
+	if (history.Back().Observation == NumCells && Corner[tagstate.AgentCell])
 	{
 		actions.push_back(4);
 		return;
@@ -231,10 +400,16 @@ void TAG::GeneratePreferred(const STATE& state, const HISTORY& history,
 	// Don't double back and don't go into walls
 	for (int d = 0; d < 4; ++d)
 		if (history.Back().Action != COORD::Opposite(d)
-			&& Inside(tagstate.AgentPos + COORD::Compass[d]))
+			&& MoveTable[tagstate.AgentCell * 4 + d] != tagstate.AgentCell)
 			actions.push_back(d);
 }
 
+const ACTION_SET* TAG::LegalActions(const STATE& state,
+	const STATUS& status) const
+{
+	return &AllActions;
+}
+
 void TAG::DisplayBeliefs(const BELIEF_STATE& beliefState,
 	std::ostream& ostr) const
 {
@@ -243,21 +418,20 @@ void TAG::DisplayBeliefs(const BELIEF_STATE& beliefState,
 void TAG::DisplayState(const STATE& state, std::ostream& ostr) const
 {
 	const TAG_STATE& tagstate = safe_cast<const TAG_STATE&>(state);
-	GRID<char> cgrid(10, 5);
-	cgrid.SetAllValues('.');
+	vector<char> cells(NumCells, '.');
 	for (int opp = 0; opp < NumOpponents; ++opp)
 		if (IsAlive(tagstate, opp))
-			cgrid(tagstate.OpponentPos[opp]) = '@';
-	cgrid(tagstate.AgentPos) = '*';
+			cells[tagstate.OpponentCell[opp]] = '@';
+	cells[tagstate.AgentCell] = '*';
 
-	for (int y = 4; y >= 0; y--)
+	for (int y = CellIndex.GetYSize() - 1; y >= 0; y--)
 	{
-		for (int x = 0; x < 10; x++)
+		for (int x = 0; x < CellIndex.GetXSize(); x++)
 		{
-			COORD pos(x, y);
-			if (Inside(pos))
+			int cell = CellIndex(x, y);
+			if (cell >= 0)
 			{
-				ostr << cgrid(pos) << ' ';
+				ostr << cells[cell] << ' ';
 			}
 			else
 			{
@@ -273,8 +447,8 @@ void TAG::DisplayObservation(const STATE& state, int observation, std::ostream&
 	if (observation == NumCells)
 		ostr << "On opponent" << endl;
 	else
-		ostr << "Agent is at (" << GetCoord(observation).X << ", "
-		<< GetCoord(observation).Y << ")" << endl;
+		ostr << "Agent is at (" << CellPos[observation].X << ", "
+		<< CellPos[observation].Y << ")" << endl;
 }
 
 void TAG::DisplayAction(int action, std::ostream& ostr) const
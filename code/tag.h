@@ -4,31 +4,65 @@
 #include "simulator.h"
 #include "coord.h"
 #include "grid.h"
+#include <string>
 
 class TAG_STATE : public STATE
 {
 public:
 
-	COORD AgentPos;
-	std::vector<COORD> OpponentPos;
+	int AgentCell;
+	std::vector<int> OpponentCell; // -1 once tagged
 	int NumAlive;
 };
 
+// Lanes of tag states for StepBatch
+class TAG_BATCH : public STATE_BATCH
+{
+public:
+
+	TAG_BATCH(int size, int numOpponents)
+		: STATE_BATCH(size),
+		AgentCell(size, 0),
+		OpponentCell(size * numOpponents, -1),
+		NumAlive(size, 0)
+	{
+	}
+
+	std::vector<int> AgentCell;
+	std::vector<int> OpponentCell; // Indexed by opponent * Size + lane
+	std::vector<int> NumAlive;
+};
+
 class TAG : public SIMULATOR
 {
 public:
 
+	// Original 29 cell map
 	TAG(int numrobots);
 
+	// Map loaded from a text file, one row per line with the top row first:
+	// '.' is an open cell, anything else is a wall
+	TAG(int numrobots, const std::string& mapFile);
+
 	virtual STATE* Copy(const STATE& state) const;
 	virtual void Validate(const STATE& state) const;
+	virtual size_t GetMemoryUsage() const;
 	virtual STATE* CreateStartState() const;
 	virtual void FreeState(STATE* state) const;
 	virtual bool Step(STATE& state, int action,
 		int& observation, double& reward) const;
 
+	virtual STATE_BATCH* CreateBatch(int size) const;
+	virtual void LoadBatch(STATE_BATCH& batch, int lane, const STATE& state,
+		const HISTORY& history) const;
+	virtual void SelectRandomBatch(STATE_BATCH& batch, const STATUS& status) const;
+	virtual void StepBatch(STATE_BATCH& batch) const;
+	static void UnitTest();
+
 	void GeneratePreferred(const STATE& state, const HISTORY& history,
 		std::vector<int>& legal, const STATUS& status) const;
+	virtual const ACTION_SET* LegalActions(const STATE& state,
+		const STATUS& status) const;
 	virtual bool LocalMove(STATE& state, const HISTORY& history,
 		int stepObs, const STATUS& status) const;
 
@@ -38,22 +72,37 @@ public:
 	virtual void DisplayObservation(const STATE& state, int observation, std::ostream& ostr) const;
 	virtual void DisplayAction(int action, std::ostream& ostr) const;
 
+	int GetNumCells() const { return NumCells; }
+
 protected:
 
+	void InitMap(const std::vector<std::string>& rows);
+	void InitTables();
 	void MoveOpponent(TAG_STATE& tagstate, int opp) const;
 	int GetObservation(const TAG_STATE& tagstate, int action) const;
-	bool Inside(const COORD& coord) const;
-	COORD GetCoord(int index) const;
-	int GetIndex(const COORD& coord) const;
 	bool IsAlive(const TAG_STATE& tagstate, int opp) const;
-	bool IsCorner(const COORD& coord) const;
-	COORD GetRandomCorner() const;
 
 	int NumOpponents;
-	static const int NumCells;
+	int NumCells;
+
+	GRID<int> CellIndex;		// Cell index of each map position, -1 for walls
+	std::vector<COORD> CellPos;	// Map position of each cell
+	std::vector<bool> Corner;	// Dead ends and bends: one open neighbour, or two not opposite
+
+	// Cell reached from each cell in each compass direction
+	// (the same cell if the move is blocked), indexed by cell * 4 + dir
+	std::vector<int> MoveTable;
+
+	// Alias tables of the opponent move, indexed by
+	// (agent * NumCells + opponent) * 5 + outcome,
+	// where outcomes 0-3 are compass moves and 4 is staying put
+	static const int NumOpponentMoves = 5;
+	std::vector<double> OpponentThreshold;
+	std::vector<int> OpponentAlias;
 
 private:
 
+	ACTION_SET AllActions;
 	mutable MEMORY_POOL<TAG_STATE> MemoryPool;
 };
 
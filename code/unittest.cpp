@@ -0,0 +1,31 @@
+#include "coord.h"
+#include "network.h"
+#include "planner.h"
+#include "random.h"
+#include "rocksample.h"
+#include "tabularpomdp.h"
+#include "tag.h"
+#include "utils.h"
+#include <iostream>
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// Runs the unit tests that are self-contained and deterministic enough to
+// gate a build. Each test asserts, so this must not be built with NDEBUG
+
+int main()
+{
+	UTILS::RandomSeed(1);
+	UTILS::UnitTest();
+	COORD::UnitTest();
+	FastRandom::unitTest();
+	ThompsonSampling::unitTest();
+	SYMBOL::UnitTest();
+	TABULAR_POMDP::UnitTest();
+	ROCKSAMPLE::UnitTest();
+	TAG::UnitTest();
+	NETWORK::UnitTest();
+	cout << "All tests passed" << endl;
+	return 0;
+}
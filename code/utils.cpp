@@ -1,8 +1,92 @@
 #include "utils.h"
+#include <fstream>
+#include <string>
+#include <thread>
+#include <time.h>
 
 namespace UTILS
 {
 
+	thread_local uint64_t RandomWordState = 0x9E3779B97F4A7C15ULL;
+
+	uint64_t BernoulliWord(double p)
+	{
+		// Combine random words from the least significant binary digit
+		// of p upwards: OR-ing with a fair word maps probability q to
+		// (1 + q) / 2 and AND-ing maps it to q / 2
+		static const int Digits = 16;
+		int fixed = (int)(p * (1 << Digits) + 0.5);
+		if (fixed <= 0)
+			return 0;
+		if (fixed >= (1 << Digits))
+			return ~uint64_t(0);
+		uint64_t word = 0;
+		for (int d = __builtin_ctz(fixed); d < Digits; ++d)
+		{
+			if (fixed & (1 << d))
+				word |= RandomWord();
+			else
+				word &= RandomWord();
+		}
+		return word;
+	}
+
+	size_t PeakResidentBytes()
+	{
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while (std::getline(status, line))
+		{
+			if (line.compare(0, 6, "VmHWM:") == 0)
+				return (size_t) atol(line.c_str() + 6) * 1024;
+		}
+		return 0;
+	}
+
+	double ThreadCpuSeconds()
+	{
+		struct timespec now;
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0)
+			return 0;
+		return now.tv_sec + now.tv_nsec * 1e-9;
+	}
+
+	void BuildAliasTable(const double* probs, int n, double* threshold, int* alias)
+	{
+		double total = 0;
+		for (int i = 0; i < n; ++i)
+			total += probs[i];
+		assert(total > 0);
+
+		std::vector<int> small, large;
+		for (int i = 0; i < n; ++i)
+		{
+			threshold[i] = probs[i] * n / total;
+			alias[i] = i;
+			if (threshold[i] < 1.0)
+				small.push_back(i);
+			else
+				large.push_back(i);
+		}
+		while (!small.empty() && !large.empty())
+		{
+			int s = small.back(), l = large.back();
+			small.pop_back();
+			alias[s] = l;
+			threshold[l] -= 1.0 - threshold[s];
+			if (threshold[l] < 1.0)
+			{
+				large.pop_back();
+				small.push_back(l);
+			}
+		}
+		// Remaining entries are full up to rounding error
+		for (size_t i = 0; i < small.size(); ++i)
+			threshold[small[i]] = 1.0;
+		for (size_t i = 0; i < large.size(); ++i)
+			threshold[large[i]] = 1.0;
+	}
+
 	void UnitTest()
 	{
 		assert(Sign(+10) == +1);
@@ -19,10 +103,43 @@ namespace UTILS
 		assert(Near(n[4], 2500, 250));
 		assert(Near(n[5], 2000, 250));
 
+		// Each thread has its own generator: a thread seeded alike draws
+		// the same sequence, whatever other threads draw meanwhile
+		const int draws = 16;
+		int expected[draws], drawn[draws];
+		RandomWordSeed(7);
+		for (int i = 0; i < draws; i++)
+			expected[i] = Random(1000);
+		std::thread other([&drawn]()
+		{
+			RandomWordSeed(7);
+			for (int i = 0; i < draws; i++)
+				drawn[i] = Random(1000);
+		});
+		for (int i = 0; i < 1000; i++)
+			Random(1000);
+		other.join();
+		for (int i = 0; i < draws; i++)
+			assert(drawn[i] == expected[i]);
+
 		int c = 0;
 		for (int i = 0; i < 10000; i++)
 			c += Bernoulli(0.5);
 		assert(Near(c, 5000, 250));
+		int w = 0;
+		for (int i = 0; i < 1000; i++)
+			w += __builtin_popcountll(BernoulliWord(0.25));
+		assert(Near(w, 16000, 800));
+
+		double probs[4] = { 0.1, 0.2, 0.3, 0.4 };
+		double threshold[4];
+		int alias[4];
+		int a[4] = { 0 };
+		BuildAliasTable(probs, 4, threshold, alias);
+		for (int i = 0; i < 10000; i++)
+			a[SampleAlias(threshold, alias, 4)]++;
+		for (int i = 0; i < 4; i++)
+			assert(Near(a[i], 10000 * probs[i], 250));
 		assert(CheckFlag(5, 0));
 		assert(!CheckFlag(5, 1));
 		assert(CheckFlag(5, 2));
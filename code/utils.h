@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <math.h>
 #include <assert.h>
+#include <stdint.h>
 #include "coord.h"
 #include "memorypool.h"
 #include <algorithm>
@@ -27,29 +28,78 @@ namespace UTILS
 		return (x > 0) - (x < 0);
 	}
 
+	// State of the fast 64-bit generator behind all the random draws below,
+	// one per thread, so that rollout threads neither contend for it nor
+	// disturb each other's sequences. A new thread must be seeded
+	extern thread_local uint64_t RandomWordState;
+
+	inline void RandomWordSeed(uint64_t seed)
+	{
+		RandomWordState = 0x9E3779B97F4A7C15ULL * (seed + 1);
+	}
+
+	// Also seeds rand(), for the library algorithms that use it
+	inline void RandomSeed(int seed)
+	{
+		srand(seed);
+		RandomWordSeed(seed);
+	}
+
+	// 64 random bits (xorshift64*)
+	inline uint64_t RandomWord()
+	{
+		RandomWordState ^= RandomWordState >> 12;
+		RandomWordState ^= RandomWordState << 25;
+		RandomWordState ^= RandomWordState >> 27;
+		return RandomWordState * 0x2545F4914F6CDD1DULL;
+	}
+
+	// Uniform in [0, 1), with 53 random bits
+	inline double RandomUnit()
+	{
+		return (RandomWord() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	// Uniform in [0, max), by scaling 32 random bits rather than dividing
 	inline int Random(int max)
 	{
-		return rand() % max;
+		return (int)(((RandomWord() >> 32) * (uint64_t)max) >> 32);
 	}
 
 	inline int Random(int min, int max)
 	{
-		return rand() % (max - min) + min;
+		return Random(max - min) + min;
 	}
 
 	inline double RandomDouble(double min, double max)
 	{
-		return (double)rand() / RAND_MAX * (max - min) + min;
+		return RandomUnit() * (max - min) + min;
 	}
 
-	inline void RandomSeed(int seed)
+	inline bool Bernoulli(double p)
 	{
-		srand(seed);
+		return RandomUnit() < p;
 	}
 
-	inline bool Bernoulli(double p)
+	// 64 independent Bernoulli(p) bits, p is rounded to 16 binary digits
+	uint64_t BernoulliWord(double p);
+
+	// Peak resident set size of this process in bytes, from VmHWM in
+	// /proc/self/status, or 0 where that is not available
+	size_t PeakResidentBytes();
+
+	// CPU seconds used by the calling thread, or 0 where that is not available
+	double ThreadCpuSeconds();
+
+	// Walker's alias method: build threshold and alias arrays for n
+	// outcomes in O(n), then sample an outcome in O(1)
+	void BuildAliasTable(const double* probs, int n, double* threshold, int* alias);
+
+	inline int SampleAlias(const double* threshold, const int* alias, int n)
 	{
-		return rand() < p * RAND_MAX;
+		double r = RandomUnit() * n;
+		int i = (int)r;
+		return r - i < threshold[i] ? i : alias[i];
 	}
 
 	inline bool Near(double x, double y, double tol)